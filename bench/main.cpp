@@ -0,0 +1,589 @@
+// CPU side benchmarks. Needs no window or GL context:
+//     ./rg_bench [--json path] [--only group] [--warmup n] [--repetitions n] [primitives...]
+// Groups are import, decode, transforms, cull, sort, bvh and occlusion; primitives are the
+// scene sizes of the BVH group. Every measurement is printed, and with --json also written as
+// one JSON object for tracking trends across commits.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/model.h>
+#include <rg/BenchReport.h>
+#include <rg/Bvh.h>
+#include <rg/MappedFile.h>
+#include <rg/RenderQueue.h>
+#include <rg/SoftwareOcclusion.h>
+#include <rg/ThreadPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Options
+{
+    std::string json;
+    std::string only;
+    // untimed runs before the timed ones, to fill caches and fault in memory
+    int warmup = 1;
+    // overrides the repetitions each benchmark picks for itself when positive
+    int repetitions = 0;
+};
+Options options;
+
+// statistics of the timed runs of one benchmark, in milliseconds
+struct Measurement
+{
+    std::string name;
+    int repetitions = 0;
+    double mean = 0.0;
+    double stddev = 0.0;
+    double min = 0.0;
+    double median = 0.0;
+    double max = 0.0;
+};
+std::vector<Measurement> measurements;
+
+bool enabled(const char* group) { return options.only.empty() || options.only == group; }
+
+// runs f warmup times, then times repetitions runs of it
+template <typename F> const Measurement& measure(const std::string& name, int repetitions, F&& f)
+{
+    if (options.repetitions > 0)
+        repetitions = options.repetitions;
+    repetitions = std::max(repetitions, 1);
+    for (int i = 0; i < options.warmup; i++)
+        f();
+    std::vector<double> times;
+    for (int i = 0; i < repetitions; i++)
+    {
+        Clock::time_point start = Clock::now();
+        f();
+        times.push_back(elapsedMs(start));
+    }
+    std::sort(times.begin(), times.end());
+
+    Measurement m;
+    m.name = name;
+    m.repetitions = repetitions;
+    for (double t : times)
+        m.mean += t;
+    m.mean /= repetitions;
+    for (double t : times)
+        m.stddev += (t - m.mean) * (t - m.mean);
+    // sample standard deviation
+    m.stddev = repetitions > 1 ? std::sqrt(m.stddev / (repetitions - 1)) : 0.0;
+    m.min = times.front();
+    m.median = times[times.size() / 2];
+    m.max = times.back();
+    std::printf(
+        "  %-44s %10.3f ms median, %10.3f mean +- %5.1f%%, min %10.3f, max %10.3f (%d runs)\n",
+        name.c_str(), m.median, m.mean, m.mean > 0.0 ? 100.0 * m.stddev / m.mean : 0.0, m.min,
+        m.max, repetitions);
+    measurements.push_back(m);
+    return measurements.back();
+}
+
+bool writeJson(const std::string& path)
+{
+    std::ofstream out(path);
+    if (!out)
+        return false;
+    out << "{\n";
+    out << "  \"warmup\": " << options.warmup << ",\n";
+    out << "  \"peak_memory_bytes\": " << rg::BenchReport::PeakMemoryBytes() << ",\n";
+    out << "  \"benchmarks\": [";
+    for (size_t i = 0; i < measurements.size(); i++)
+    {
+        const Measurement& m = measurements[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": \"" << m.name
+            << "\", \"repetitions\": " << m.repetitions << ", \"mean_ms\": " << m.mean
+            << ", \"stddev_ms\": " << m.stddev << ", \"min_ms\": " << m.min
+            << ", \"median_ms\": " << m.median << ", \"max_ms\": " << m.max << "}";
+    }
+    out << "\n  ]\n}\n";
+    return (bool)out;
+}
+
+// the models the scene loads
+const char* const MODEL_FILES[] = {
+    "resources/objects/gary/gary.obj",       "resources/objects/house/house.obj",
+    "resources/objects/patrick/patrick.obj", "resources/objects/squid/squid.obj",
+    "resources/objects/sponge/sponge.obj",   "resources/objects/krabs/krabs.obj",
+    "resources/objects/karen/karenbyanto.obj"};
+
+// Assimp import and mesh conversion of every model of the scene, and the stb decode of the
+// textures they reference. The mesh cache is bypassed: this is what a cold start pays.
+void benchModels()
+{
+    std::set<std::string> textures;
+    for (const char* path : MODEL_FILES)
+    {
+        std::string file = path;
+        std::string name = file.substr(file.find_last_of('/') + 1);
+        if (!rg::MappedFile(file).isOpen())
+        {
+            std::printf("MODELS:: %s not found, run from the repository root\n", path);
+            continue;
+        }
+        if (enabled("import"))
+            measure(
+                "assimp read " + name, 3,
+                [&]
+                {
+                    Assimp::Importer importer;
+                    importer.ReadFile(file, Model::importFlags);
+                });
+
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(file, Model::importFlags);
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+        {
+            std::printf("MODELS:: %s: %s\n", path, importer.GetErrorString());
+            continue;
+        }
+        std::vector<const aiMesh*> meshes;
+        Model::processNode(scene->mRootNode, scene, meshes);
+        size_t vertices = 0, indices = 0;
+        if (enabled("import"))
+        {
+            measure(
+                "process meshes " + name, 10,
+                [&]
+                {
+                    vertices = indices = 0;
+                    for (const aiMesh* mesh : meshes)
+                    {
+                        MeshData data = Model::processMesh(mesh, scene);
+                        vertices += data.vertices.size();
+                        indices += data.indices.size();
+                    }
+                });
+            std::printf(
+                "MODELS:: %s: %zu meshes, %zu vertices, %zu triangles\n", name.c_str(),
+                meshes.size(), vertices, indices / 3);
+        }
+        std::string directory = file.substr(0, file.find_last_of('/'));
+        for (const aiMesh* mesh : meshes)
+            for (const TextureRef& ref : Model::processMesh(mesh, scene).textures)
+                textures.insert(directory + "/" + ref.path);
+    }
+
+    if (!enabled("decode"))
+        return;
+    // decoded from memory, so the numbers leave out the disk
+    for (const std::string& path : textures)
+    {
+        rg::MappedFile file(path);
+        if (!file.isOpen())
+        {
+            std::printf("DECODE:: %s not found\n", path.c_str());
+            continue;
+        }
+        int width = 0, height = 0, components = 0;
+        measure(
+            "stb decode " + path.substr(path.find('/', path.find('/') + 1) + 1), 3,
+            [&]
+            {
+                unsigned char* pixels = stbi_load_from_memory(
+                    file.data(), (int)file.size(), &width, &height, &components, 0);
+                stbi_image_free(pixels);
+            });
+        std::printf(
+            "DECODE:: %s: %d x %d, %d components, %zu KB encoded\n", path.c_str(), width, height,
+            components, file.size() / 1024);
+    }
+}
+
+// model matrices built the way the render loop builds them for every object, and the world
+// space bounds the scene BVH is refit with
+void benchTransforms(size_t count)
+{
+    struct Placement
+    {
+        glm::vec3 position;
+        glm::vec3 rotation;
+        float scale;
+    };
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<Placement> placements(count);
+    for (Placement& placement : placements)
+    {
+        placement.position = glm::vec3(unit(rng), unit(rng), unit(rng)) * 100.0f - glm::vec3(50.0f);
+        placement.rotation = glm::vec3(unit(rng), unit(rng), unit(rng)) * 360.0f;
+        placement.scale = 0.1f + unit(rng);
+    }
+    std::string size = std::to_string(count);
+
+    std::vector<glm::mat4> transforms(count);
+    measure(
+        "model matrices " + size, 20,
+        [&]
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                const Placement& placement = placements[i];
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), placement.position);
+                model = glm::rotate(
+                    model, glm::radians(placement.rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+                model = glm::rotate(
+                    model, glm::radians(placement.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+                model = glm::rotate(
+                    model, glm::radians(placement.rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+                transforms[i] = glm::scale(model, glm::vec3(placement.scale));
+            }
+        });
+
+    rg::Bounds local;
+    local.min = glm::vec3(-1.0f, 0.0f, -1.0f);
+    local.max = glm::vec3(1.0f, 2.0f, 1.0f);
+    local.center = glm::vec3(0.0f, 1.0f, 0.0f);
+    local.radius = glm::length(local.max - local.center);
+    std::vector<rg::Bounds> world(count);
+    measure(
+        "world bounds " + size, 20,
+        [&]
+        {
+            for (size_t i = 0; i < count; i++)
+                world[i] = local.transformed(transforms[i]);
+        });
+}
+
+// objects of varying size scattered over a 1 km square, a few clustered towns among open space
+std::vector<rg::Bounds> randomScene(size_t count, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<glm::vec3> towns(16);
+    for (glm::vec3& town : towns)
+        town = glm::vec3(unit(rng) * 1000.0f - 500.0f, 0.0f, unit(rng) * 1000.0f - 500.0f);
+    std::normal_distribution<float> spread(0.0f, 40.0f);
+    std::vector<rg::Bounds> scene(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 center;
+        if (i % 4)
+            center = towns[i % towns.size()] + glm::vec3(spread(rng), 0.0f, spread(rng));
+        else
+            center = glm::vec3(unit(rng) * 1000.0f - 500.0f, 0.0f, unit(rng) * 1000.0f - 500.0f);
+        glm::vec3 half = glm::vec3(0.5f, 1.0f, 0.5f) * (0.5f + 4.0f * unit(rng) * unit(rng));
+        center.y = half.y;
+        rg::Bounds& bounds = scene[i];
+        bounds.min = center - half;
+        bounds.max = center + half;
+        bounds.center = center;
+        bounds.radius = glm::length(half);
+    }
+    return scene;
+}
+
+void benchBvh(size_t count)
+{
+    std::mt19937 rng(1234);
+    std::vector<rg::Bounds> scene = randomScene(count, rng);
+    rg::Bvh bvh;
+    std::string size = std::to_string(count);
+    double build = measure("bvh build " + size, 5, [&] { bvh.build(scene); }).median;
+
+    // everything drifts a little, as objects dragged around or animated would
+    std::vector<rg::Bounds> moved = scene;
+    std::uniform_real_distribution<float> drift(-0.5f, 0.5f);
+    for (rg::Bounds& bounds : moved)
+    {
+        glm::vec3 offset(drift(rng), 0.0f, drift(rng));
+        bounds.min += offset;
+        bounds.max += offset;
+        bounds.center += offset;
+    }
+    double refit = measure("bvh refit " + size, 5, [&] { bvh.refit(moved); }).median;
+
+    // cameras on the ground looking around, 150 m far plane
+    const int queries = 1000;
+    std::uniform_real_distribution<float> coordinate(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+    std::vector<rg::Frustum> frustums(queries);
+    std::vector<rg::Ray> rays(queries);
+    std::vector<glm::vec3> spheres(queries);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 150.0f);
+    for (int i = 0; i < queries; i++)
+    {
+        glm::vec3 eye(coordinate(rng), 1.7f, coordinate(rng));
+        float yaw = angle(rng);
+        glm::vec3 front(std::cos(yaw), -0.05f, std::sin(yaw));
+        frustums[i] = rg::Frustum::FromMatrix(
+            projection * glm::lookAt(eye, eye + front, glm::vec3(0.0f, 1.0f, 0.0f)));
+        rays[i].origin = eye;
+        rays[i].direction = front;
+        spheres[i] = eye;
+    }
+
+    size_t visible = 0, hits = 0, overlaps = 0;
+    double frustum = measure(
+        "bvh 1000 frustum queries " + size, 3,
+        [&]
+        {
+            visible = 0;
+            for (const rg::Frustum& f : frustums)
+                bvh.queryFrustum(f, [&](unsigned int) { visible++; });
+        }).median;
+    double ray = measure(
+        "bvh 1000 raycasts " + size, 3,
+        [&]
+        {
+            hits = 0;
+            for (const rg::Ray& r : rays)
+                hits += bvh.raycast(r).primitive != rg::Bvh::NONE;
+        }).median;
+    double sphere = measure(
+        "bvh 1000 sphere queries " + size, 3,
+        [&]
+        {
+            overlaps = 0;
+            for (const glm::vec3& center : spheres)
+                bvh.querySphere(center, 10.0f, [&](unsigned int) { overlaps++; });
+        }).median;
+
+    std::printf(
+        "BVH:: %8zu primitives, %7zu nodes, depth %2u, SAH %.1f -> %.1f refit | build %8.2f ms,"
+        " refit %6.2f ms | per query: frustum %7.2f us (%zu visible), ray %5.2f us (%.0f%% hit),"
+        " sphere %5.2f us (%zu found)\n",
+        count, bvh.nodes().size(), bvh.depth(), bvh.builtCost(), bvh.cost(), build, refit,
+        frustum * 1000.0 / queries, visible / queries, ray * 1000.0 / queries,
+        100.0 * hits / queries, sphere * 1000.0 / queries, overlaps / queries);
+}
+
+// the per object tests of the render loop, without the BVH: frustum culling and LOD selection
+void benchCulling(size_t count)
+{
+    std::mt19937 rng(42);
+    std::vector<rg::Bounds> scene = randomScene(count, rng);
+    glm::vec3 eye(0.0f, 1.7f, 0.0f);
+    glm::mat4 viewProjection =
+        glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 150.0f) *
+        glm::lookAt(eye, glm::vec3(1.0f, 1.7f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    std::string size = std::to_string(count);
+
+    rg::FrustumCuller culler(viewProjection, true);
+    size_t visible = 0;
+    measure(
+        "frustum cull " + size, 20,
+        [&]
+        {
+            visible = 0;
+            for (const rg::Bounds& bounds : scene)
+                visible += culler.visible(bounds);
+        });
+
+    // a chain of halving levels with growing error, like buildLodChain makes
+    std::vector<rg::MeshLod> lods(rg::MAX_LODS);
+    for (unsigned int level = 0; level < rg::MAX_LODS; level++)
+    {
+        lods[level].indexCount = 3000u >> level;
+        lods[level].error = level ? 0.01f * (float)(1u << level) : 0.0f;
+    }
+    rg::LodSelector selector(eye, glm::radians(45.0f), 1080.0f, 0.0f);
+    size_t levels = 0;
+    measure(
+        "lod select " + size, 20,
+        [&]
+        {
+            levels = 0;
+            for (const rg::Bounds& bounds : scene)
+                levels += selector.select(lods, bounds.center, bounds.radius, 1.0f);
+        });
+    std::printf(
+        "CULL:: %zu objects, %.0f%% in the frustum, mean lod %.2f\n", count,
+        100.0 * visible / count, (double)levels / count);
+}
+
+// a frame of draws through the render queue: interning its state, submitting and sorting
+void benchRenderQueue(size_t count)
+{
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<unsigned int> pick(0, 1 << 20);
+    std::uniform_real_distribution<float> depth(0.0f, 100.0f);
+    struct Draw
+    {
+        unsigned int program, vao, textures[2];
+        bool cullFace, transparent;
+        float depth;
+    };
+    std::vector<Draw> draws(count);
+    for (Draw& draw : draws)
+    {
+        draw.program = 1 + pick(rng) % 4;
+        draw.vao = 1 + pick(rng) % 32;
+        draw.textures[0] = 1 + pick(rng) % 64;
+        draw.textures[1] = 65 + pick(rng) % 64;
+        draw.cullFace = pick(rng) % 2;
+        draw.transparent = pick(rng) % 8 == 0;
+        draw.depth = depth(rng);
+    }
+    const GLint units[2] = {0, 1};
+    glm::mat4 transform(1.0f);
+    std::string size = std::to_string(count);
+
+    rg::RenderQueue queue;
+    measure(
+        "render queue submit " + size, 20,
+        [&]
+        {
+            queue.reset(100.0f);
+            for (const Draw& draw : draws)
+            {
+                rg::DrawPacket packet;
+                packet.program = queue.addProgram(draw.program, 0);
+                packet.vao = queue.addVertexArray(draw.vao);
+                packet.material = queue.addMaterial(draw.textures, units, 2);
+                packet.transform = queue.addTransform(transform);
+                packet.cullFace = draw.cullFace;
+                queue.submit(
+                    packet,
+                    draw.transparent ? rg::RenderPass::Transparent : rg::RenderPass::Opaque,
+                    draw.depth);
+            }
+        });
+    measure("render queue sort " + size, 20, [&] { queue.sort(); });
+}
+
+// closed box of 12 triangles
+rg::Occluder boxOccluder(const glm::vec3& min, const glm::vec3& max)
+{
+    rg::Occluder occluder;
+    for (int corner = 0; corner < 8; corner++)
+        occluder.positions.push_back(glm::vec3(
+            corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y, corner & 4 ? max.z : min.z));
+    occluder.indices = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                        2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+    return occluder;
+}
+
+// a street seen from eye height: rows of house sized occluders with small objects behind them
+void benchOcclusion(size_t objects, rg::ThreadPool& pool)
+{
+    std::mt19937 rng(99);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<rg::Occluder> occluders;
+    std::vector<glm::mat4> transforms;
+    for (int row = 0; row < 4; row++)
+        for (int i = 0; i < 12; i++)
+        {
+            glm::vec3 position(-60.0f + i * 10.0f, 0.0f, -15.0f - row * 20.0f);
+            occluders.push_back(boxOccluder(glm::vec3(-4.0f, 0.0f, -4.0f), glm::vec3(4.0f)));
+            transforms.push_back(glm::translate(glm::mat4(1.0f), position));
+        }
+    std::vector<rg::Bounds> boxes(objects);
+    for (rg::Bounds& box : boxes)
+    {
+        glm::vec3 center(unit(rng) * 120.0f - 60.0f, 0.5f, -unit(rng) * 100.0f);
+        box.min = center - glm::vec3(0.5f);
+        box.max = center + glm::vec3(0.5f);
+        box.center = center;
+        box.radius = 0.87f;
+    }
+    glm::mat4 viewProjection =
+        glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 200.0f) *
+        glm::lookAt(
+            glm::vec3(0.0f, 1.7f, 0.0f), glm::vec3(0.0f, 1.7f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    rg::SoftwareOcclusion occlusion;
+    unsigned int occluded = 0;
+    auto frame = [&](rg::ThreadPool* threads)
+    {
+        occlusion.begin(viewProjection);
+        for (size_t i = 0; i < occluders.size(); i++)
+            occlusion.addOccluder(occluders[i], transforms[i]);
+        occlusion.rasterize(threads);
+        occluded = 0;
+        for (const rg::Bounds& box : boxes)
+            occluded += !occlusion.visible(box);
+    };
+    double serial = measure("occlusion frame", 20, [&] { frame(nullptr); }).median;
+    rg::OcclusionStats stats = occlusion.stats();
+    double threaded = measure("occlusion frame threaded", 20, [&] { frame(&pool); }).median;
+    std::printf(
+        "OCCLUSION:: %u occluders, %u triangles, %u boxes, %.0f%% occluded | frame %.3f ms,"
+        " %.3f ms on %u threads | transform %.3f ms, rasterize %.3f ms, test %.3f ms"
+        " (%.3f us per box)\n",
+        stats.occluders, stats.triangles, stats.tested, 100.0 * occluded / stats.tested, serial,
+        threaded, pool.size() + 1, stats.transformMs, stats.rasterizeMs, stats.testMs,
+        stats.testMs * 1000.0 / stats.tested);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool value = i + 1 < argc;
+        if (arg == "--json" && value)
+            options.json = argv[++i];
+        else if (arg == "--only" && value)
+            options.only = argv[++i];
+        else if (arg == "--warmup" && value)
+            options.warmup = std::max(std::atoi(argv[++i]), 0);
+        else if (arg == "--repetitions" && value)
+            options.repetitions = std::atoi(argv[++i]);
+        else if (arg[0] != '-')
+            counts.push_back(std::strtoul(argv[i], nullptr, 10));
+        else
+        {
+            std::printf(
+                "usage: %s [--json path] [--only group] [--warmup n] [--repetitions n]"
+                " [primitives...]\n",
+                argv[0]);
+            return 1;
+        }
+    }
+    if (counts.empty())
+        counts = {10000, 100000, 1000000};
+
+    if (enabled("import") || enabled("decode"))
+        benchModels();
+    if (enabled("transforms"))
+        benchTransforms(10000);
+    if (enabled("cull"))
+        benchCulling(100000);
+    if (enabled("sort"))
+        benchRenderQueue(10000);
+    if (enabled("bvh"))
+        for (size_t count : counts)
+            benchBvh(count);
+    if (enabled("occlusion"))
+    {
+        rg::ThreadPool pool;
+        benchOcclusion(10000, pool);
+    }
+
+    if (measurements.empty())
+        std::printf("BENCH:: nothing measured, no group named %s\n", options.only.c_str());
+    if (!options.json.empty())
+    {
+        if (!writeJson(options.json))
+        {
+            std::printf("BENCH:: could not write %s\n", options.json.c_str());
+            return 1;
+        }
+        std::printf(
+            "BENCH:: wrote %zu measurements to %s\n", measurements.size(), options.json.c_str());
+    }
+    return 0;
+}
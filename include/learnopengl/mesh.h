@@ -7,7 +7,14 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+#include <rg/GeometryPool.h>
+#include <rg/InstanceBuffer.h>
+#include <rg/Lod.h>
+#include <rg/RenderQueue.h>
+#include <rg/VertexPacking.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 using namespace std;
@@ -33,42 +40,235 @@ struct Texture
     string path;
 };
 
+// texture binding of a mesh before the image itself is loaded; path is relative to the model
+struct TextureRef
+{
+    string type;
+    string path;
+};
+
+// CPU-side result of importing a mesh: everything needed to build a Mesh, without any GL objects.
+// indices holds every level of detail, one after another, as described by lods.
+struct MeshData
+{
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<TextureRef> textures;
+    vector<rg::MeshLod> lods;
+    // object space box and sphere of the vertices
+    rg::Bounds bounds;
+};
+
+// layout of the vertex buffer on the GPU. Float uploads Vertex as is (56 bytes), Packed uploads
+// rg::PackedVertex (20 bytes) and needs the packed vertex shader (2.model_lighting_packed.vs).
+enum class VertexFormat
+{
+    Float,
+    Packed
+};
+
 class Mesh
 {
   public:
+    // largest vertex count that can be drawn with GL_UNSIGNED_SHORT indices
+    static const size_t MAX_SHORT_INDEXED_VERTICES = 65536;
+
     // mesh Data
     vector<Vertex> vertices;
     vector<unsigned int> indices;
     vector<Texture> textures;
 
-    unsigned int VAO;
     std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    VertexFormat format;
+    // where the vertices and indices live in the shared buffers of Pool(format). Meshes with at
+    // most 65536 vertices get 16-bit indices (geometry.indexType).
+    rg::GeometryAllocation geometry;
+    // dequantization of packed positions, and how far the packed vertices are off
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    rg::PackingError packingError;
+    // index ranges of the levels of detail, level 0 is the full mesh
+    vector<rg::MeshLod> lods;
+    // object space bounds, for LOD selection and frustum culling
+    rg::Bounds bounds;
+    // constructor; bounds are computed from the vertices when not given
+    Mesh(
+        vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures,
+        VertexFormat format = VertexFormat::Float, vector<rg::MeshLod> lods = {},
+        rg::Bounds bounds = rg::Bounds())
+        : format(format), bounds(bounds)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->lods = std::move(lods);
+        if (this->lods.empty())
+        {
+            this->lods.resize(1);
+            this->lods[0].indexCount = this->indices.size();
+        }
+        if (this->bounds.empty())
+            this->bounds = rg::Bounds::FromVertices(this->vertices);
 
         // now that we have all the required data, set the vertex buffers and its attribute
         // pointers.
         setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader& shader)
+    // shared buffers of all meshes with the given vertex format
+    static rg::GeometryPool& Pool(VertexFormat format)
+    {
+        static rg::GeometryPool floatPool(sizeof(Vertex), setupFloatAttributes);
+        static rg::GeometryPool packedPool(sizeof(rg::PackedVertex), setupPackedAttributes);
+        return format == VertexFormat::Packed ? packedPool : floatPool;
+    }
+
+    // per-instance matrices of Model::DrawInstanced, shared by all models
+    static rg::InstanceBuffer& Instances()
+    {
+        static rg::InstanceBuffer instances;
+        return instances;
+    }
+
+    // deletes the shared buffers while the GL context is still alive; later Release() calls are
+    // ignored
+    static void DestroyPools()
+    {
+        Pool(VertexFormat::Float).destroy();
+        Pool(VertexFormat::Packed).destroy();
+        Instances().destroy();
+    }
+
+    // returns the mesh's ranges to its pool. Meshes are copied around freely, so this is up to
+    // the owner (Model) rather than a destructor.
+    void Release() { Pool(format).free(geometry); }
+
+    // render the mesh at the given level of detail
+    void Draw(Shader& shader, unsigned int lod = 0)
+    {
+        rg::GLState::Instance().bindVertexArray(Pool(format).vao());
+        DrawBound(shader, lod);
+    }
+
+    // like Draw, but expects the VAO of Pool(format) to be bound already, so consecutive meshes
+    // of the same format don't rebind it
+    void DrawBound(Shader& shader, unsigned int lod = 0)
+    {
+        const ProgramUniforms& uniforms = m_Uniforms[uniformsFor(shader)];
+        bindTextures(uniforms);
+        drawElements(uniforms, lod);
+    }
+
+    // DrawBound for instanceCount instances, with the instanced VAO of Pool(format) bound and
+    // the shader compiled with INSTANCED
+    void DrawBoundInstanced(Shader& shader, GLsizei instanceCount, unsigned int lod = 0)
+    {
+        const ProgramUniforms& uniforms = m_Uniforms[uniformsFor(shader)];
+        bindTextures(uniforms);
+        drawElements(uniforms, lod, instanceCount);
+    }
+
+    // queues the mesh instead of drawing it; the queue binds the textures and the pool's VAO.
+    // program and transform are indices from queue.addProgram / addTransform, depth the distance
+    // to the camera. The mesh must stay where it is until the queue has executed.
+    void Submit(
+        rg::RenderQueue& queue, const Shader& shader, unsigned int program, unsigned int transform,
+        unsigned int lod, bool cullFace, float depth)
+    {
+        unsigned int uniforms = uniformsFor(shader);
+
+        unsigned int textureIds[rg::MAX_TEXTURE_UNITS];
+        unsigned int textureCount = std::min((unsigned int)textures.size(), rg::MAX_TEXTURE_UNITS);
+        for (unsigned int i = 0; i < textureCount; i++)
+            textureIds[i] = textures[i].id;
+
+        rg::DrawPacket packet;
+        packet.program = program;
+        packet.vao = queue.addVertexArray(Pool(format).vao());
+        packet.material =
+            queue.addMaterial(textureIds, m_Uniforms[uniforms].units.data(), textureCount);
+        packet.transform = transform;
+        packet.cullFace = cullFace;
+        // the argument carries the level of detail and which program's uniforms to use
+        packet.draw = [](const void* object, unsigned int argument)
+        {
+            const Mesh* mesh = static_cast<const Mesh*>(object);
+            mesh->drawElements(mesh->m_Uniforms[argument >> 8], argument & 0xff);
+        };
+        packet.object = this;
+        packet.argument = uniforms << 8 | lod;
+        queue.submit(packet, rg::RenderPass::Opaque, depth);
+    }
+
+  private:
+    // uniform locations and sampler units of the mesh in each program it has been drawn with, so
+    // drawing doesn't build sampler names or look anything up
+    struct ProgramUniforms
+    {
+        unsigned int program;
+        // unit of each texture, -1 where the program has no sampler for it
+        vector<GLint> units;
+        Shader::Uniform<glm::vec3> positionOffset, positionScale;
+    };
+    vector<ProgramUniforms> m_Uniforms;
+    // prefix the sampler names were resolved with
+    std::string m_UniformPrefix;
+
+    void bindTextures(const ProgramUniforms& uniforms)
     {
-        // bind appropriate textures
+        rg::GLState& state = rg::GLState::Instance();
+        // the program's samplers point at their units since it was linked, so only the textures
+        // change, and only if the unit doesn't hold them already
+        for (unsigned int i = 0; i < textures.size(); i++)
+            if (uniforms.units[i] >= 0)
+                state.bindTexture(uniforms.units[i], GL_TEXTURE_2D, textures[i].id);
+    }
+
+    // per mesh uniforms and the draw call; indices are relative to the mesh's first vertex in
+    // the shared buffer. Instance counts other than 1 draw instanced.
+    void drawElements(
+        const ProgramUniforms& uniforms, unsigned int lod, GLsizei instanceCount = 1) const
+    {
+        if (format == VertexFormat::Packed)
+        {
+            glUniform3fv(uniforms.positionOffset.location, 1, &positionOffset[0]);
+            glUniform3fv(uniforms.positionScale.location, 1, &positionScale[0]);
+        }
+        size_t indexOffset =
+            geometry.indexByteOffset + lods[lod].indexOffset * rg::indexSize(geometry.indexType);
+        if (instanceCount != 1)
+            glDrawElementsInstancedBaseVertex(
+                GL_TRIANGLES, lods[lod].indexCount, geometry.indexType, (void*)indexOffset,
+                instanceCount, geometry.baseVertex);
+        else
+            glDrawElementsBaseVertex(
+                GL_TRIANGLES, lods[lod].indexCount, geometry.indexType, (void*)indexOffset,
+                geometry.baseVertex);
+    }
+
+    // index of the shader's entry in m_Uniforms, resolved on first use
+    unsigned int uniformsFor(const Shader& shader)
+    {
+        if (glslIdentifierPrefix != m_UniformPrefix)
+        {
+            m_Uniforms.clear();
+            m_UniformPrefix = glslIdentifierPrefix;
+        }
+        for (unsigned int i = 0; i < m_Uniforms.size(); i++)
+            if (m_Uniforms[i].program == shader.ID)
+                return i;
+
+        ProgramUniforms uniforms;
+        uniforms.program = shader.ID;
         unsigned int diffuseNr = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr = 1;
         unsigned int heightNr = 1;
-        for (unsigned int i = 0; i < textures.size(); i++)
+        for (const Texture& texture : textures)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
-            string name = textures[i].type;
+            const string& name = texture.type;
             if (name == "texture_diffuse")
                 number = std::to_string(diffuseNr++);
             else if (name == "texture_specular")
@@ -77,50 +277,52 @@ class Mesh
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
             else if (name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(
-                glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            uniforms.units.push_back(
+                shader.samplerUnit((glslIdentifierPrefix + name + number).c_str()));
         }
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        uniforms.positionOffset = shader.uniform<glm::vec3>("positionOffset");
+        uniforms.positionScale = shader.uniform<glm::vec3>("positionScale");
+        m_Uniforms.push_back(uniforms);
+        return (unsigned int)m_Uniforms.size() - 1;
     }
 
-  private:
-    // render data
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
+    // copies the mesh into the shared buffers of its vertex format
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly
-        // to a glm::vec3/2 array which again translates to 3/2 floats which translates to a byte
-        // array.
-        glBufferData(
-            GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(
-            GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0],
-            GL_STATIC_DRAW);
+        // halves the index memory of every mesh small enough
+        vector<unsigned short> shortIndices;
+        const void* indexData = indices.data();
+        GLenum indexType = GL_UNSIGNED_INT;
+        if (vertices.size() <= MAX_SHORT_INDEXED_VERTICES)
+        {
+            shortIndices.assign(indices.begin(), indices.end());
+            indexData = shortIndices.data();
+            indexType = GL_UNSIGNED_SHORT;
+        }
+
+        if (format == VertexFormat::Packed)
+        {
+            rg::PackedVertices packed = rg::packVertices(vertices);
+            positionOffset = packed.positionOffset;
+            positionScale = packed.positionScale;
+            packingError = packed.error;
+            geometry = Pool(format).allocate(
+                packed.vertices.data(), packed.vertices.size(), indexData, indices.size(),
+                indexType);
+        }
+        else
+        {
+            // A great thing about structs is that their memory layout is sequential for all its
+            // items. The effect is that we can simply pass a pointer to the struct and it
+            // translates perfectly to a glm::vec3/2 array which again translates to 3/2 floats
+            // which translates to a byte array.
+            geometry = Pool(format).allocate(
+                vertices.data(), vertices.size(), indexData, indices.size(), indexType);
+        }
+    }
 
+    static void setupFloatAttributes()
+    {
         // set the vertex attribute pointers
         // vertex Positions
         glEnableVertexAttribArray(0);
@@ -141,8 +343,27 @@ class Mesh
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(
             4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+    }
 
-        glBindVertexArray(0);
+    static void setupPackedAttributes()
+    {
+        const GLsizei stride = sizeof(rg::PackedVertex);
+        // vertex positions (xyz) and bitangent sign (w), normalized to 0..1
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(
+            0, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(rg::PackedVertex, position));
+        // octahedral normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(
+            1, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(rg::PackedVertex, normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(
+            2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(rg::PackedVertex, texCoords));
+        // octahedral tangents, the bitangent is rebuilt in the shader
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(
+            3, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(rg::PackedVertex, tangent));
     }
 };
 #endif
@@ -12,17 +12,39 @@
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
+#include <rg/Frustum.h>
+#include <rg/MeshCache.h>
+#include <rg/MeshOptimizer.h>
+#include <rg/MeshSimplifier.h>
+#include <rg/Profiler.h>
+#include <rg/SoftwareOcclusion.h>
+#include <rg/TexturePipeline.h>
+#include <rg/TextureRegistry.h>
+#include <rg/ThreadPool.h>
 
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <map>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
 
+// CPU-side result of importing a model file. Produced by Model::Import on any thread and turned
+// into GL objects by the Model constructor on the thread that owns the context.
+struct ModelData
+{
+    string directory;
+    vector<MeshData> meshes;
+    // stbi_set_flip_vertically_on_load value the model's textures are loaded with
+    bool flipTextures = true;
+    bool valid = false;
+};
+
 class Model
 {
   public:
@@ -30,54 +52,257 @@ class Model
     vector<Texture> textures_loaded; // stores all the textures loaded so far, optimization to make
                                      // sure textures aren't loaded more than once.
     vector<Mesh> meshes;
+    // object space bounds of all meshes
+    rg::Bounds bounds;
     string directory;
     bool gammaCorrection;
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma) { loadModel(path); }
+    // constructor, expects a filepath to a 3D model. Imports synchronously and loads textures
+    // with the current stbi flip setting.
+    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    {
+        ModelData data = Import(path);
+        directory = data.directory;
+        createMeshes(data);
+    }
+
+    // constructor from an already imported model (see ImportAsync). Only creates the GL objects,
+    // so it has to run on the context thread. Textures are decoded by the pipeline in the
+    // background and show up once it uploads them. Packed vertices need the packed vertex shader.
+    Model(
+        ModelData data, rg::TexturePipeline& texturePipeline,
+        VertexFormat vertexFormat = VertexFormat::Float, bool gamma = false)
+        : gammaCorrection(gamma), texturePipeline(&texturePipeline),
+          flipTextures(data.flipTextures), vertexFormat(vertexFormat)
+    {
+        directory = data.directory;
+        createMeshes(data);
+    }
+
+    // registry textures are shared with other models; they are released here and deleted when
+    // their last user goes away. Geometry goes back to the shared pools.
+    ~Model()
+    {
+        for (Mesh& mesh : meshes)
+            mesh.Release();
+        if (!texturePipeline)
+            return;
+        for (const Texture& texture : textures_loaded)
+            rg::TextureRegistry::Instance().release(texture.id);
+    }
+
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
 
-    // draws the model, and thus all its meshes
+    // reads a model with supported ASSIMP extensions and converts its meshes, without touching
+    // OpenGL. Geometry comes from the binary mesh cache when it is up to date. With a pool, the
+    // per-mesh conversion of large files is spread over its workers.
+    static ModelData Import(
+        string const& path, bool flipTextures = true, rg::ThreadPool* pool = nullptr)
+    {
+        RG_PROFILE_ZONE("Model import");
+        ModelData data;
+        data.flipTextures = flipTextures;
+        // retrieve the directory path of the filepath
+        data.directory = path.substr(0, path.find_last_of('/'));
+
+        if (!rg::MeshCache::Load(path, importFlags, data.meshes))
+        {
+            // read file via ASSIMP
+            Assimp::Importer importer;
+            const aiScene* scene;
+            {
+                RG_PROFILE_ZONE("Assimp read");
+                scene = importer.ReadFile(path, importFlags);
+            }
+            // check for errors
+            if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
+                !scene->mRootNode) // if is Not Zero
+            {
+                cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                return data;
+            }
+
+            // process ASSIMP's root node recursively
+            vector<const aiMesh*> sceneMeshes;
+            processNode(scene->mRootNode, scene, sceneMeshes);
+            vector<vector<MeshData>> converted(sceneMeshes.size());
+            vector<rg::MeshOptimizationStats> optimization(sceneMeshes.size());
+            auto convert = [&](size_t i)
+            {
+                RG_PROFILE_ZONE("Mesh conversion");
+                MeshData mesh = processMesh(sceneMeshes[i], scene);
+                optimization[i] = rg::optimizeMesh(mesh.vertices, mesh.indices);
+                converted[i] = splitForShortIndices(std::move(mesh));
+                for (MeshData& part : converted[i])
+                {
+                    part.lods = rg::buildLodChain(part.vertices, part.indices);
+                    part.bounds = rg::Bounds::FromVertices(part.vertices);
+                }
+            };
+            if (pool)
+                pool->parallelFor(sceneMeshes.size(), convert);
+            else
+                for (size_t i = 0; i < sceneMeshes.size(); i++)
+                    convert(i);
+            for (vector<MeshData>& parts : converted)
+                for (MeshData& part : parts)
+                    data.meshes.push_back(std::move(part));
+            logOptimization(path, optimization);
+            logLods(path, data.meshes);
+            // the cache holds the optimized meshes and their LODs, so warm starts skip the
+            // optimizer and the simplifier as well
+            rg::MeshCache::Store(path, importFlags, data.meshes);
+        }
+        data.valid = true;
+        return data;
+    }
+
+    // runs Import on the pool. Feed the result to the Model constructor on the context thread.
+    static std::future<ModelData> ImportAsync(
+        rg::ThreadPool& pool, string const& path, bool flipTextures = true)
+    {
+        return pool.submit([&pool, path, flipTextures]
+                           { return Import(path, flipTextures, &pool); });
+    }
+
+    // draws the model, and thus all its meshes, at full detail
     void Draw(Shader& shader)
     {
+        rg::GLState::Instance().bindVertexArray(Mesh::Pool(vertexFormat).vao());
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].DrawBound(shader);
     }
 
-    void SetShaderTextureNamePrefix(std::string prefix)
+    // draws count copies of the model in one instanced draw per mesh, one matrix per copy. The
+    // shader has to be built with the INSTANCED define, which takes the model matrix from the
+    // instance attribute instead of the "model" uniform.
+    void DrawInstanced(
+        Shader& shader, const glm::mat4* transforms, size_t count, unsigned int lod = 0)
+    {
+        if (count == 0)
+            return;
+        rg::InstanceBuffer& instances = Mesh::Instances();
+        instances.upload(transforms, count);
+        rg::GLState::Instance().bindVertexArray(Mesh::Pool(vertexFormat).instancedVao(instances));
+        for (Mesh& mesh : meshes)
+            mesh.DrawBoundInstanced(
+                shader, (GLsizei)count, std::min(lod, (unsigned int)mesh.lods.size() - 1));
+    }
+
+    void DrawInstanced(Shader& shader, const vector<glm::mat4>& transforms, unsigned int lod = 0)
+    {
+        DrawInstanced(shader, transforms.data(), transforms.size(), lod);
+    }
+
+    // draws every mesh at the level of detail its projected size calls for. model is the matrix
+    // the shader's "model" uniform is set to. With a culler, meshes outside the view frustum are
+    // skipped, and the whole model when its combined bounds are.
+    void Draw(
+        Shader& shader, const glm::mat4& model, const rg::LodSelector& lodSelector,
+        const rg::FrustumCuller* culler = nullptr)
     {
+        if (culler && !culler->visibleModel(bounds.transformed(model), meshes.size()))
+            return;
+        // uniform scale is assumed, the largest axis is used otherwise
+        float scale = std::max(
+            glm::length(glm::vec3(model[0])),
+            std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        // all meshes of a model share one pool, so the VAO is bound once
+        rg::GLState::Instance().bindVertexArray(Mesh::Pool(vertexFormat).vao());
         for (Mesh& mesh : meshes)
         {
-            mesh.glslIdentifierPrefix = prefix;
+            rg::Bounds world = mesh.bounds.transformed(model);
+            if (culler && !culler->visible(world))
+                continue;
+            unsigned int lod = lodSelector.select(mesh.lods, world.center, world.radius, scale);
+            lodSelector.record(mesh.lods[lod], lod);
+            mesh.DrawBound(shader, lod);
         }
     }
 
-  private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in
-    // the meshes vector.
-    void loadModel(string const& path)
+    // queues every mesh at the level of detail its projected size calls for, instead of drawing
+    // right away; the queue sets the shader's "model" uniform to model. Culling works as in Draw.
+    void Submit(
+        rg::RenderQueue& queue, const Shader& shader, const glm::mat4& model,
+        const rg::LodSelector& lodSelector, bool cullFace = false,
+        const rg::FrustumCuller* culler = nullptr)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(
-            path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs |
-                      aiProcess_CalcTangentSpace);
-        // check for errors
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
-            !scene->mRootNode) // if is Not Zero
-        {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        if (culler && !culler->visibleModel(bounds.transformed(model), meshes.size()))
             return;
+        float scale = std::max(
+            glm::length(glm::vec3(model[0])),
+            std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        unsigned int program = queue.addProgram(shader.ID, shader.location("model"));
+        unsigned int transform = queue.addTransform(model);
+        for (Mesh& mesh : meshes)
+        {
+            rg::Bounds world = mesh.bounds.transformed(model);
+            if (culler && !culler->visible(world))
+                continue;
+            unsigned int lod = lodSelector.select(mesh.lods, world.center, world.radius, scale);
+            lodSelector.record(mesh.lods[lod], lod);
+            float depth = glm::length(world.center - lodSelector.cameraPosition);
+            mesh.Submit(queue, shader, program, transform, lod, cullFace, depth);
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+    }
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+    // worst vertex quantization error over all meshes, zero for VertexFormat::Float
+    rg::PackingError PackingError() const
+    {
+        rg::PackingError error;
+        for (const Mesh& mesh : meshes)
+            error.merge(mesh.packingError);
+        return error;
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node
-    // and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
+    // occlusion culling stand-in: every mesh at its coarsest level of detail whose error stays
+    // within maxRelativeError of the mesh's radius, so it barely sticks out of the real surface
+    rg::Occluder BuildOccluder(float maxRelativeError = 0.02f) const
+    {
+        rg::Occluder occluder;
+        occluder.bounds = bounds;
+        for (const Mesh& mesh : meshes)
+        {
+            unsigned int level = 0;
+            for (unsigned int i = 1; i < mesh.lods.size(); i++)
+                if (mesh.lods[i].error <= maxRelativeError * mesh.bounds.radius)
+                    level = i;
+            const rg::MeshLod& lod = mesh.lods[level];
+            // only the vertices the level uses, renumbered
+            vector<unsigned int> remap(mesh.vertices.size(), ~0u);
+            for (unsigned int i = lod.indexOffset; i < lod.indexOffset + lod.indexCount; i++)
+            {
+                unsigned int& index = remap[mesh.indices[i]];
+                if (index == ~0u)
+                {
+                    index = (unsigned int)occluder.positions.size();
+                    occluder.positions.push_back(mesh.vertices[mesh.indices[i]].Position);
+                }
+                occluder.indices.push_back(index);
+            }
+        }
+        return occluder;
+    }
+
+    void SetShaderTextureNamePrefix(std::string prefix)
+    {
+        for (Mesh& mesh : meshes)
+        {
+            mesh.glslIdentifierPrefix = prefix;
+        }
+    }
+
+    // the steps of Import, public so rg_bench can time them one by one
+
+    // assimp post-processing applied on import. Part of the mesh cache key, so changing these
+    // invalidates existing caches.
+    static const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals |
+                                            aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+    // walks the node hierarchy recursively and collects the meshes located at each node, in the
+    // order they should end up in the meshes vector.
+    static void processNode(aiNode* node, const aiScene* scene, vector<const aiMesh*>& out)
     {
         // process each mesh located at the current node
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -85,28 +310,29 @@ class Model
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations
             // between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            out.push_back(scene->mMeshes[node->mMeshes[i]]);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the
         // children nodes
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, out);
         }
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    static MeshData processMesh(const aiMesh* mesh, const aiScene* scene)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex>& vertices = data.vertices;
+        vector<unsigned int>& indices = data.indices;
 
         // walk through each of the mesh's vertices
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
+            // zeroed: meshes without texture coordinates leave the tangent frame unset, and the
+            // welding and the mesh cache see every byte
+            Vertex vertex{};
             glm::vec3 vector; // we declare a placeholder vector since assimp_ uses its own vector
                               // class that doesn't directly convert to glm's vec3 class so we
                               // transfer the data to this placeholder glm::vec3 first.
@@ -170,61 +396,143 @@ class Model
         material->Get(AI_MATKEY_COLOR_AMBIENT, color);
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps =
-            loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        vector<TextureRef>& textures = data.textures;
+        collectMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
         // 2. specular maps
-        vector<Texture> specularMaps =
-            loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        collectMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps =
-            loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        collectMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
         // 4. height maps
-        std::vector<Texture> heightMaps =
-            loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        collectMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data; GL objects are created later by createMesh
+        return data;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded
-    // yet. the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+  private:
+    // asynchronous texture loading, TextureFromFile is used when there is no pipeline
+    rg::TexturePipeline* texturePipeline = nullptr;
+    bool flipTextures = true;
+    VertexFormat vertexFormat = VertexFormat::Float;
+    // textures_loaded index by model-relative path
+    unordered_map<string, size_t> textureIndex;
+
+    // meshes with more vertices than 16-bit indices can address are cut into several meshes
+    static vector<MeshData> splitForShortIndices(MeshData mesh)
+    {
+        vector<MeshData> result;
+        if (mesh.vertices.size() <= Mesh::MAX_SHORT_INDEXED_VERTICES)
+        {
+            result.push_back(std::move(mesh));
+            return result;
+        }
+        auto parts = rg::splitMesh(mesh.vertices, mesh.indices, Mesh::MAX_SHORT_INDEXED_VERTICES);
+        for (auto& part : parts)
+        {
+            MeshData partData;
+            partData.vertices = std::move(part.vertices);
+            partData.indices = std::move(part.indices);
+            partData.textures = mesh.textures;
+            result.push_back(std::move(partData));
+        }
+        return result;
+    }
+
+    static void logOptimization(
+        const string& path, const vector<rg::MeshOptimizationStats>& optimization)
+    {
+        rg::MeshOptimizationStats total;
+        for (const rg::MeshOptimizationStats& stats : optimization)
+            total.merge(stats);
+        cout << "MESH_OPTIMIZER:: " << path << ": " << total.verticesBefore << " -> "
+             << total.verticesAfter << " vertices, ACMR " << total.before.acmr << " -> "
+             << total.after.acmr << ", ATVR " << total.before.atvr << " -> " << total.after.atvr
+             << endl;
+    }
+
+    static void logLods(const string& path, const vector<MeshData>& meshes)
+    {
+        unsigned int triangles[rg::MAX_LODS] = {};
+        for (const MeshData& mesh : meshes)
+        {
+            // meshes with fewer levels count with their coarsest one
+            for (unsigned int lod = 0; lod < rg::MAX_LODS; lod++)
+            {
+                size_t level = std::min<size_t>(lod, mesh.lods.size() - 1);
+                triangles[lod] += mesh.lods[level].indexCount / 3;
+            }
+        }
+        cout << "MESH_LOD:: " << path << ": triangles";
+        for (unsigned int lod = 0; lod < rg::MAX_LODS; lod++)
+            cout << (lod ? " / " : " ") << triangles[lod];
+        cout << endl;
+    }
+
+    void createMeshes(ModelData& data)
+    {
+        RG_PROFILE_ZONE("Model upload");
+        for (MeshData& meshData : data.meshes)
+        {
+            meshes.push_back(createMesh(meshData));
+            bounds.merge(meshes.back().bounds);
+        }
+    }
+
+    // records the texture paths of a given type; the images themselves are loaded in createMesh.
+    static void collectMaterialTextures(
+        aiMaterial* mat, aiTextureType type, const string& typeName, vector<TextureRef>& out)
     {
-        vector<Texture> textures;
         for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip
-            // loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded,
-                                 // continue to next one. (optimization)
-                    break;
-                }
-            }
-            if (!skip)
-            { // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(
-                    texture); // store it as texture loaded for entire model, to ensure we won't
-                              // unnecesery load duplicate textures.
-            }
+            out.push_back(TextureRef{typeName, str.C_Str()});
+        }
+    }
+
+    // loads the textures of an imported mesh and uploads its geometry
+    Mesh createMesh(MeshData& data)
+    {
+        vector<Texture> textures;
+        for (const TextureRef& ref : data.textures)
+            textures.push_back(loadMaterialTexture(ref));
+        return Mesh(
+            std::move(data.vertices), std::move(data.indices), textures, vertexFormat,
+            std::move(data.lods), data.bounds);
+    }
+
+    // loads the texture if it's not loaded yet. the required info is returned as a Texture struct.
+    Texture loadMaterialTexture(const TextureRef& ref)
+    {
+        // check if texture was loaded before and if so, skip loading a new texture
+        auto loaded = textureIndex.find(ref.path);
+        if (loaded != textureIndex.end())
+        {
+            Texture texture = textures_loaded[loaded->second]; // a texture with the same filepath
+                                                               // has already been loaded.
+            texture.type = ref.type;
+            return texture;
+        }
+        // if texture hasn't been loaded already, load it. Textures shared with other models are
+        // resolved by the process-wide registry.
+        Texture texture;
+        if (texturePipeline)
+        {
+            rg::TextureOptions options;
+            options.flip = flipTextures;
+            options.compression = ref.type == "texture_normal" ? rg::TextureCompression::NormalMap
+                                                               : rg::TextureCompression::Color;
+            texture.id = rg::TextureRegistry::Instance().acquire(
+                this->directory + '/' + ref.path, options, *texturePipeline);
         }
-        return textures;
+        else
+            texture.id = TextureFromFile(ref.path.c_str(), this->directory);
+        texture.type = ref.type;
+        texture.path = ref.path;
+        textureIndex[ref.path] = textures_loaded.size();
+        textures_loaded.push_back(texture); // store it as texture loaded for entire model, to
+                                            // ensure we won't unnecesery load duplicate textures.
+        return texture;
     }
 };
 
@@ -248,7 +556,7 @@ unsigned int TextureFromFile(const char* path, const string& directory, bool gam
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        rg::GLState::Instance().bindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -5,18 +5,32 @@
 #include <glm/glm.hpp>
 
 #include <common.h>
+#include <rg/GLState.h>
+#include <rg/Profiler.h>
+#include <rg/ProgramCache.h>
+#include <rg/UniformBlocks.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
 class Shader
 {
   public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly, or loads it from the program binary cache.
+    // defines ("NAME" or "NAME VALUE") are inserted after the #version line of every stage.
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(
+        const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+        const std::vector<std::string>& defines = {})
     {
+        RG_PROFILE_ZONE("Shader build");
+        auto start = std::chrono::steady_clock::now();
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
 
@@ -64,6 +78,28 @@ class Shader
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        std::string defineBlock;
+        for (const std::string& define : defines)
+            defineBlock += "#define " + define + "\n";
+        vertexCode = insertDefines(vertexCode, defineBlock);
+        fragmentCode = insertDefines(fragmentCode, defineBlock);
+        geometryCode = insertDefines(geometryCode, defineBlock);
+
+        // programs are cached per shader combination and defines, and keyed by their sources
+        rg::ProgramCache& programCache = rg::ProgramCache::Instance();
+        std::string variant = std::string(fragmentPath) + '|' +
+                              (geometryPath ? geometryPath : "") + '|' + defineBlock;
+        std::string cachePath = rg::ProgramCache::CachePathFor(vertexPath, variant);
+        uint64_t cacheKey = programCache.key({vertexCode, fragmentCode, geometryCode});
+        ID = glCreateProgram();
+        if (programCache.load(cachePath, cacheKey, ID))
+        {
+            reflectUniforms();
+            rg::bindUniformBlocks(ID);
+            logTiming(vertexPath, fragmentPath, "cache hit", start);
+            return;
+        }
+
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
         // 2. compile shaders
@@ -89,85 +125,297 @@ class Shader
             checkCompileErrors(geometry, "GEOMETRY");
         }
         // shader Program
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         if (geometryPath != nullptr)
             glAttachShader(ID, geometry);
+        programCache.prepare(ID);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        if (checkCompileErrors(ID, "PROGRAM"))
+            programCache.store(cachePath, cacheKey, ID);
+        reflectUniforms();
+        rg::bindUniformBlocks(ID);
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
         if (geometryPath != nullptr)
             glDeleteShader(geometry);
+        logTiming(
+            vertexPath, fragmentPath,
+            programCache.enabled() ? "compiled, cache miss" : "compiled, no binary support",
+            start);
     }
     // activate the shader
     // ------------------------------------------------------------------------
-    void use() { glUseProgram(ID); }
-    // utility uniform functions
-    // ------------------------------------------------------------------------
-    void setBool(const std::string& name, bool value) const
+    void use() { rg::GLState::Instance().useProgram(ID); }
+
+    // location of a uniform of type T, resolved once through uniform<T>() and then set without
+    // any lookup. Handles of uniforms the program doesn't have (or optimized out) are ignored.
+    template <typename T> struct Uniform
+    {
+        GLint location = -1;
+    };
+
+    template <typename T> Uniform<T> uniform(const char* name) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        Uniform<T> handle;
+        const UniformInfo* info = findUniform(name);
+        if (!info)
+            return handle;
+        if (!uniformTypeMatches<T>(info->type))
+            std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH " << name << std::endl;
+        handle.location = info->location;
+        return handle;
     }
-    // ------------------------------------------------------------------------
-    void setInt(const std::string& name, int value) const
+
+    void set(Uniform<bool> uniform, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(uniform.location, (int)value);
     }
-    // ------------------------------------------------------------------------
-    void setFloat(const std::string& name, float value) const
+    void set(Uniform<int> uniform, int value) const { glUniform1i(uniform.location, value); }
+    void set(Uniform<float> uniform, float value) const { glUniform1f(uniform.location, value); }
+    void set(Uniform<glm::vec2> uniform, const glm::vec2& value) const
+    {
+        glUniform2fv(uniform.location, 1, &value[0]);
+    }
+    void set(Uniform<glm::vec3> uniform, const glm::vec3& value) const
+    {
+        glUniform3fv(uniform.location, 1, &value[0]);
+    }
+    void set(Uniform<glm::vec4> uniform, const glm::vec4& value) const
+    {
+        glUniform4fv(uniform.location, 1, &value[0]);
+    }
+    void set(Uniform<glm::mat2> uniform, const glm::mat2& mat) const
+    {
+        glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void set(Uniform<glm::mat3> uniform, const glm::mat3& mat) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
     }
+    void set(Uniform<glm::mat4> uniform, const glm::mat4& mat) const
+    {
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+
+    // location from the table reflected at link time, -1 if the program has no such uniform
+    GLint location(const char* name) const
+    {
+        const UniformInfo* info = findUniform(name);
+        return info ? info->location : -1;
+    }
+
+    // texture unit the sampler uniform was set to at link time, -1 if the program has no such
+    // sampler. Textures for it are bound to this unit; the uniform itself is never set again.
+    GLint samplerUnit(const char* name) const
+    {
+        const UniformInfo* info = findUniform(name);
+        return info ? info->unit : -1;
+    }
+
+    // utility uniform functions; names are looked up in the location table, string literals
+    // pick the const char* overloads and don't allocate
     // ------------------------------------------------------------------------
-    void setVec2(const std::string& name, const glm::vec2& value) const
+    void setBool(const char* name, bool value) const { glUniform1i(location(name), (int)value); }
+    void setBool(const std::string& name, bool value) const { setBool(name.c_str(), value); }
+    // ------------------------------------------------------------------------
+    void setInt(const char* name, int value) const { glUniform1i(location(name), value); }
+    void setInt(const std::string& name, int value) const { setInt(name.c_str(), value); }
+    // ------------------------------------------------------------------------
+    void setFloat(const char* name, float value) const { glUniform1f(location(name), value); }
+    void setFloat(const std::string& name, float value) const { setFloat(name.c_str(), value); }
+    // ------------------------------------------------------------------------
+    void setVec2(const char* name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(location(name), 1, &value[0]);
     }
-    void setVec2(const std::string& name, float x, float y) const
+    void setVec2(const std::string& name, const glm::vec2& value) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        setVec2(name.c_str(), value);
     }
+    void setVec2(const char* name, float x, float y) const { glUniform2f(location(name), x, y); }
+    void setVec2(const std::string& name, float x, float y) const { setVec2(name.c_str(), x, y); }
     // ------------------------------------------------------------------------
+    void setVec3(const char* name, const glm::vec3& value) const
+    {
+        glUniform3fv(location(name), 1, &value[0]);
+    }
     void setVec3(const std::string& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec3(name.c_str(), value);
+    }
+    void setVec3(const char* name, float x, float y, float z) const
+    {
+        glUniform3f(location(name), x, y, z);
     }
     void setVec3(const std::string& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        setVec3(name.c_str(), x, y, z);
     }
     // ------------------------------------------------------------------------
+    void setVec4(const char* name, const glm::vec4& value) const
+    {
+        glUniform4fv(location(name), 1, &value[0]);
+    }
     void setVec4(const std::string& name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec4(name.c_str(), value);
+    }
+    void setVec4(const char* name, float x, float y, float z, float w) const
+    {
+        glUniform4f(location(name), x, y, z, w);
     }
-    void setVec4(const std::string& name, float x, float y, float z, float w)
+    void setVec4(const std::string& name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        setVec4(name.c_str(), x, y, z, w);
     }
     // ------------------------------------------------------------------------
+    void setMat2(const char* name, const glm::mat2& mat) const
+    {
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat2(const std::string& name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(name.c_str(), mat);
     }
     // ------------------------------------------------------------------------
+    void setMat3(const char* name, const glm::mat3& mat) const
+    {
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat3(const std::string& name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(name.c_str(), mat);
     }
     // ------------------------------------------------------------------------
+    void setMat4(const char* name, const glm::mat4& mat) const
+    {
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(name.c_str(), mat);
     }
 
   private:
-    // utility function for checking shader compilation/linking errors.
+    struct UniformInfo
+    {
+        std::string name;
+        GLint location;
+        GLenum type;
+        // texture unit of a sampler, -1 for anything else
+        GLint unit = -1;
+    };
+    // every active uniform of the program sorted by name; arrays are listed both as "name" and
+    // per element as "name[i]"
+    std::vector<UniformInfo> m_Uniforms;
+
+    const UniformInfo* findUniform(const char* name) const
+    {
+        auto it = std::lower_bound(
+            m_Uniforms.begin(), m_Uniforms.end(), name,
+            [](const UniformInfo& info, const char* key)
+            { return std::strcmp(info.name.c_str(), key) < 0; });
+        if (it == m_Uniforms.end() || std::strcmp(it->name.c_str(), name) != 0)
+            return nullptr;
+        return &*it;
+    }
+
+    // builds the location table; the only place glGetUniformLocation is called
+    void reflectUniforms()
+    {
+        m_Uniforms.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> buffer(maxLength + 1);
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            // members of uniform blocks have no location
+            if (location < 0)
+                continue;
+            m_Uniforms.push_back(UniformInfo{name, location, type, -1});
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                m_Uniforms.push_back(UniformInfo{base, location, type, -1});
+                for (GLint element = 1; element < size; ++element)
+                {
+                    std::string elementName = base + '[' + std::to_string(element) + ']';
+                    GLint elementLocation = glGetUniformLocation(ID, elementName.c_str());
+                    m_Uniforms.push_back(UniformInfo{elementName, elementLocation, type, -1});
+                }
+            }
+        }
+        std::sort(
+            m_Uniforms.begin(), m_Uniforms.end(),
+            [](const UniformInfo& a, const UniformInfo& b) { return a.name < b.name; });
+        assignSamplerUnits();
+    }
+
+    // gives every sampler of the program a unit of its own, in name order, and sets it once
+    void assignSamplerUnits()
+    {
+        std::vector<GLint> locations;
+        for (UniformInfo& info : m_Uniforms)
+        {
+            if (info.type != GL_SAMPLER_2D && info.type != GL_SAMPLER_CUBE &&
+                info.type != GL_SAMPLER_3D)
+                continue;
+            // an array's first element is listed under two names
+            auto it = std::find(locations.begin(), locations.end(), info.location);
+            if (it != locations.end())
+            {
+                info.unit = (GLint)(it - locations.begin());
+                continue;
+            }
+            if (locations.size() == rg::GLState::MAX_UNITS)
+            {
+                std::cout << "ERROR::SHADER::TOO_MANY_SAMPLERS " << info.name << std::endl;
+                continue;
+            }
+            if (locations.empty())
+                rg::GLState::Instance().useProgram(ID);
+            info.unit = (GLint)locations.size();
+            locations.push_back(info.location);
+            glUniform1i(info.location, info.unit);
+        }
+    }
+
+    template <typename T> static bool uniformTypeMatches(GLenum type);
+
+    // puts the defines right after the #version line, which has to stay first
+    static std::string insertDefines(const std::string& code, const std::string& defineBlock)
+    {
+        if (defineBlock.empty() || code.empty())
+            return code;
+        size_t lineEnd = code.compare(0, 8, "#version") == 0 ? code.find('\n') : std::string::npos;
+        if (lineEnd == std::string::npos)
+            return defineBlock + code;
+        return code.substr(0, lineEnd + 1) + defineBlock + code.substr(lineEnd + 1);
+    }
+
+    static void logTiming(
+        const char* vertexPath, const char* fragmentPath, const char* how,
+        std::chrono::steady_clock::time_point start)
+    {
+        double ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        std::cout << "SHADER:: " << vertexPath << " + " << fragmentPath << ": " << how << ", "
+                  << ms << " ms" << std::endl;
+    }
+
+    // utility function for checking shader compilation/linking errors; returns true on success
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -195,6 +443,40 @@ class Shader
                           << std::endl;
             }
         }
+        return success;
     }
 };
+
+template <> inline bool Shader::uniformTypeMatches<bool>(GLenum type) { return type == GL_BOOL; }
+// samplers are set through int uniforms
+template <> inline bool Shader::uniformTypeMatches<int>(GLenum type)
+{
+    return type == GL_INT || type == GL_SAMPLER_2D || type == GL_SAMPLER_CUBE ||
+           type == GL_SAMPLER_3D;
+}
+template <> inline bool Shader::uniformTypeMatches<float>(GLenum type) { return type == GL_FLOAT; }
+template <> inline bool Shader::uniformTypeMatches<glm::vec2>(GLenum type)
+{
+    return type == GL_FLOAT_VEC2;
+}
+template <> inline bool Shader::uniformTypeMatches<glm::vec3>(GLenum type)
+{
+    return type == GL_FLOAT_VEC3;
+}
+template <> inline bool Shader::uniformTypeMatches<glm::vec4>(GLenum type)
+{
+    return type == GL_FLOAT_VEC4;
+}
+template <> inline bool Shader::uniformTypeMatches<glm::mat2>(GLenum type)
+{
+    return type == GL_FLOAT_MAT2;
+}
+template <> inline bool Shader::uniformTypeMatches<glm::mat3>(GLenum type)
+{
+    return type == GL_FLOAT_MAT3;
+}
+template <> inline bool Shader::uniformTypeMatches<glm::mat4>(GLenum type)
+{
+    return type == GL_FLOAT_MAT4;
+}
 #endif
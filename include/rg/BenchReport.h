@@ -0,0 +1,110 @@
+#ifndef PROJECT_BASE_BENCHREPORT_H
+#define PROJECT_BASE_BENCHREPORT_H
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace rg
+{
+
+// What a benchmark run measured, written as one JSON object so CI can diff runs. Frame times are
+// summarized as nearest-rank percentiles; draws and triangles are per frame averages and maxima.
+class BenchReport
+{
+  public:
+    std::string renderer;
+    unsigned int width = 0;
+    unsigned int height = 0;
+    double startupMs = 0.0;
+
+    void addFrame(double milliseconds, unsigned int drawCalls, unsigned long long triangles)
+    {
+        m_FrameMs.push_back(milliseconds);
+        m_DrawCalls.push_back(drawCalls);
+        m_Triangles.push_back(triangles);
+    }
+
+    size_t frames() const { return m_FrameMs.size(); }
+
+    // p in [0, 100]
+    double percentileMs(double p) const
+    {
+        if (m_FrameMs.empty())
+            return 0.0;
+        std::vector<double> sorted = m_FrameMs;
+        std::sort(sorted.begin(), sorted.end());
+        size_t rank = (size_t)std::ceil(p / 100.0 * (double)sorted.size());
+        return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+    }
+
+    // the high water mark of the process' resident set
+    static unsigned long long PeakMemoryBytes()
+    {
+        rusage usage = {};
+        getrusage(RUSAGE_SELF, &usage);
+        // kilobytes on Linux
+        return (unsigned long long)usage.ru_maxrss * 1024ull;
+    }
+
+    bool write(const std::string& path) const
+    {
+        std::ofstream out(path);
+        if (!out)
+            return false;
+        double totalMs = 0.0;
+        for (double ms : m_FrameMs)
+            totalMs += ms;
+        unsigned long long draws = 0, triangles = 0, maxDraws = 0, maxTriangles = 0;
+        for (size_t i = 0; i < frames(); ++i)
+        {
+            draws += m_DrawCalls[i];
+            triangles += m_Triangles[i];
+            maxDraws = std::max(maxDraws, (unsigned long long)m_DrawCalls[i]);
+            maxTriangles = std::max(maxTriangles, m_Triangles[i]);
+        }
+        double count = frames() ? (double)frames() : 1.0;
+        out << "{\n";
+        out << "  \"renderer\": \"" << escaped(renderer) << "\",\n";
+        out << "  \"width\": " << width << ",\n";
+        out << "  \"height\": " << height << ",\n";
+        out << "  \"frames\": " << frames() << ",\n";
+        out << "  \"startup_ms\": " << startupMs << ",\n";
+        out << "  \"frame_ms\": {\"mean\": " << totalMs / count
+            << ", \"p50\": " << percentileMs(50.0) << ", \"p95\": " << percentileMs(95.0)
+            << ", \"p99\": " << percentileMs(99.0) << ", \"max\": " << percentileMs(100.0)
+            << "},\n";
+        out << "  \"draw_calls\": {\"mean\": " << (double)draws / count << ", \"max\": " << maxDraws
+            << "},\n";
+        out << "  \"triangles\": {\"mean\": " << (double)triangles / count
+            << ", \"max\": " << maxTriangles << "},\n";
+        out << "  \"peak_memory_bytes\": " << PeakMemoryBytes() << "\n";
+        out << "}\n";
+        return (bool)out;
+    }
+
+  private:
+    std::vector<double> m_FrameMs;
+    std::vector<unsigned int> m_DrawCalls;
+    std::vector<unsigned long long> m_Triangles;
+
+    static std::string escaped(const std::string& text)
+    {
+        std::string result;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                result += '\\';
+            if ((unsigned char)c >= 0x20)
+                result += c;
+        }
+        return result;
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_BENCHREPORT_H
@@ -0,0 +1,365 @@
+#ifndef PROJECT_BASE_BLOCKCOMPRESSION_H
+#define PROJECT_BASE_BLOCKCOMPRESSION_H
+
+#include <rg/ThreadPool.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace rg
+{
+
+// CPU encoders for the block compressed formats we upload with glCompressedTexImage2D:
+//   BC1 (DXT1)  - RGB, 8 bytes per 4x4 block
+//   BC3 (DXT5)  - RGBA, BC4 alpha + BC1 color, 16 bytes per block
+//   BC5 (RGTC2) - two BC4 channels (normal map X/Y), 16 bytes per block
+// Endpoints come from the (inset) bounding box of the block, which is fast and good enough for
+// albedo and normal maps. Input is always tightly packed RGBA8. With SSE2 the bounding box and
+// the index search of both block types work on a row of four texels at a time; the results are
+// the same as the scalar code's.
+namespace bc
+{
+
+enum class Format
+{
+    BC1,
+    BC3,
+    BC5
+};
+
+inline size_t blockBytes(Format format) { return format == Format::BC1 ? 8 : 16; }
+
+inline size_t compressedSize(Format format, int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+// 4x4 block of RGBA8 texels, rows stored one after another
+struct Block
+{
+    uint8_t texels[64];
+};
+
+// copies the block at (bx, by), clamping at the image edges for sizes that aren't multiples of 4
+inline void fetchBlock(const uint8_t* rgba, int width, int height, int bx, int by, Block& block)
+{
+    for (int y = 0; y < 4; ++y)
+    {
+        int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; ++x)
+        {
+            int sx = std::min(bx * 4 + x, width - 1);
+            std::memcpy(&block.texels[(y * 4 + x) * 4], &rgba[((size_t)sy * width + sx) * 4], 4);
+        }
+    }
+}
+
+// per-channel minimum and maximum over the 16 texels
+inline void blockBounds(const Block& block, uint8_t minColor[4], uint8_t maxColor[4])
+{
+#if defined(__SSE2__)
+    const __m128i* rows = reinterpret_cast<const __m128i*>(block.texels);
+    __m128i lo = _mm_loadu_si128(rows);
+    __m128i hi = lo;
+    for (int i = 1; i < 4; ++i)
+    {
+        __m128i row = _mm_loadu_si128(rows + i);
+        lo = _mm_min_epu8(lo, row);
+        hi = _mm_max_epu8(hi, row);
+    }
+    // fold the four texels of each register onto the first one
+    lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 8));
+    hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 8));
+    lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 4));
+    hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 4));
+    uint32_t packedLo = _mm_cvtsi128_si32(lo);
+    uint32_t packedHi = _mm_cvtsi128_si32(hi);
+    std::memcpy(minColor, &packedLo, 4);
+    std::memcpy(maxColor, &packedHi, 4);
+#else
+    for (int c = 0; c < 4; ++c)
+    {
+        minColor[c] = 255;
+        maxColor[c] = 0;
+    }
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            minColor[c] = std::min(minColor[c], block.texels[i * 4 + c]);
+            maxColor[c] = std::max(maxColor[c], block.texels[i * 4 + c]);
+        }
+    }
+#endif
+}
+
+#if defined(__SSE2__)
+// squared RGB distances of the four texels of row to color, (r, g, b, 0, r, g, b, 0) as 16-bit
+// lanes, in four 32-bit lanes
+inline __m128i rgbDistances(__m128i row, __m128i color)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rgb = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+    __m128i lo = _mm_and_si128(_mm_sub_epi16(_mm_unpacklo_epi8(row, zero), color), rgb);
+    __m128i hi = _mm_and_si128(_mm_sub_epi16(_mm_unpackhi_epi8(row, zero), color), rgb);
+    // r * r + g * g and b * b of every texel, then the pairs added up
+    __m128 a = _mm_castsi128_ps(_mm_madd_epi16(lo, lo));
+    __m128 b = _mm_castsi128_ps(_mm_madd_epi16(hi, hi));
+    return _mm_add_epi32(
+        _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+        _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+// lanes of a where mask is set, of b elsewhere
+inline __m128i selectLanes(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+#endif
+
+inline uint16_t packRGB565(const int rgb[3])
+{
+    return (uint16_t)(((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3));
+}
+
+inline void unpackRGB565(uint16_t packed, int rgb[3])
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 color block (always four-color mode, so it is valid inside BC3 as well)
+inline void encodeColorBlock(const Block& block, uint8_t* out)
+{
+    uint8_t minColor[4], maxColor[4];
+    blockBounds(block, minColor, maxColor);
+
+    // the bounding box diagonal is min->max on every channel; flip the channels that are
+    // anti-correlated with green so the endpoints follow the actual color distribution
+    int mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            mean[c] += block.texels[i * 4 + c];
+    int covRG = 0, covBG = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int r = block.texels[i * 4 + 0] * 16 - mean[0];
+        int g = block.texels[i * 4 + 1] * 16 - mean[1];
+        int b = block.texels[i * 4 + 2] * 16 - mean[2];
+        covRG += r * g;
+        covBG += b * g;
+    }
+
+    int hi[3], lo[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        // inset by 1/16 of the range to reduce the error of the extremes
+        int inset = (maxColor[c] - minColor[c]) >> 4;
+        hi[c] = std::min(255, maxColor[c] - inset);
+        lo[c] = std::max(0, minColor[c] + inset);
+    }
+    if (covRG < 0)
+        std::swap(hi[0], lo[0]);
+    if (covBG < 0)
+        std::swap(hi[2], lo[2]);
+
+    uint16_t c0 = packRGB565(hi), c1 = packRGB565(lo);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        int palette[4][3];
+        unpackRGB565(c0, palette[0]);
+        unpackRGB565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+#if defined(__SSE2__)
+        __m128i colors[4];
+        for (int p = 0; p < 4; ++p)
+            colors[p] = _mm_setr_epi16(
+                palette[p][0], palette[p][1], palette[p][2], 0, palette[p][0], palette[p][1],
+                palette[p][2], 0);
+        const __m128i* rows = reinterpret_cast<const __m128i*>(block.texels);
+        for (int r = 0; r < 4; ++r)
+        {
+            __m128i row = _mm_loadu_si128(rows + r);
+            __m128i best = _mm_setzero_si128();
+            __m128i bestDistance = rgbDistances(row, colors[0]);
+            for (int p = 1; p < 4; ++p)
+            {
+                __m128i distance = rgbDistances(row, colors[p]);
+                // strictly closer, so ties keep the earlier entry
+                __m128i closer = _mm_cmplt_epi32(distance, bestDistance);
+                bestDistance = selectLanes(closer, distance, bestDistance);
+                best = selectLanes(closer, _mm_set1_epi32(p), best);
+            }
+            uint32_t lanes[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), best);
+            for (int i = 0; i < 4; ++i)
+                indices |= lanes[i] << (2 * (r * 4 + i));
+        }
+#else
+        for (int i = 0; i < 16; ++i)
+        {
+            const uint8_t* texel = &block.texels[i * 4];
+            int best = 0, bestDistance = 1 << 30;
+            for (int p = 0; p < 4; ++p)
+            {
+                int dr = texel[0] - palette[p][0];
+                int dg = texel[1] - palette[p][1];
+                int db = texel[2] - palette[p][2];
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+#endif
+    }
+    std::memcpy(out, &c0, 2);
+    std::memcpy(out + 2, &c1, 2);
+    std::memcpy(out + 4, &indices, 4);
+}
+
+// BC4 block of a single channel (0 = red ... 3 = alpha)
+inline void encodeChannelBlock(const Block& block, int channel, uint8_t* out)
+{
+    uint8_t minColor[4], maxColor[4];
+    blockBounds(block, minColor, maxColor);
+    int lo = minColor[channel], hi = maxColor[channel];
+    out[0] = (uint8_t)hi;
+    out[1] = (uint8_t)lo;
+
+    uint64_t indices = 0;
+    if (hi != lo)
+    {
+        // eight-value mode: palette[0] = hi, palette[1] = lo, then six interpolated values.
+        // Indices into that palette are ordered by value as {1, 7, 6, 5, 4, 3, 2, 0}.
+        int range = hi - lo;
+#if defined(__SSE2__)
+        const __m128i* rows = reinterpret_cast<const __m128i*>(block.texels);
+        const __m128i one = _mm_set1_epi32(1), eight = _mm_set1_epi32(8);
+        __m128i shift = _mm_cvtsi32_si128(8 * channel);
+        __m128 low = _mm_set1_ps((float)lo), fourteen = _mm_set1_ps(14.0f);
+        __m128 halfStep = _mm_set1_ps((float)range), fullRange = _mm_set1_ps(2.0f * range);
+        for (int r = 0; r < 4; ++r)
+        {
+            __m128i values = _mm_and_si128(
+                _mm_srl_epi32(_mm_loadu_si128(rows + r), shift), _mm_set1_epi32(0xff));
+            // the scalar rounding below in floats, where it is exact: the quotient of numbers
+            // this small is never rounded across an integer
+            __m128 numerator = _mm_add_ps(
+                _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(values), low), fourteen), halfStep);
+            __m128i step = _mm_cvttps_epi32(_mm_div_ps(numerator, fullRange));
+            // that order as arithmetic: 8 - step, with 8 (step 0) going to 1 and 1 (step 7)
+            // going to 0
+            __m128i index = _mm_sub_epi32(eight, step);
+            index = _mm_add_epi32(index, _mm_cmpeq_epi32(index, one));
+            index = selectLanes(_mm_cmpeq_epi32(index, eight), one, index);
+            uint32_t lanes[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), index);
+            for (int i = 0; i < 4; ++i)
+                indices |= (uint64_t)lanes[i] << (3 * (r * 4 + i));
+        }
+#else
+        static const int paletteIndex[8] = {1, 7, 6, 5, 4, 3, 2, 0};
+        for (int i = 0; i < 16; ++i)
+        {
+            int value = block.texels[i * 4 + channel];
+            // position on the lo..hi ramp in sevenths, rounded
+            int step = ((value - lo) * 14 + range) / (2 * range);
+            indices |= (uint64_t)paletteIndex[std::min(step, 7)] << (3 * i);
+        }
+#endif
+    }
+    for (int b = 0; b < 6; ++b)
+        out[2 + b] = (uint8_t)(indices >> (8 * b));
+}
+
+inline void encodeBlock(Format format, const Block& block, uint8_t* out)
+{
+    switch (format)
+    {
+    case Format::BC1:
+        encodeColorBlock(block, out);
+        break;
+    case Format::BC3:
+        encodeChannelBlock(block, 3, out);
+        encodeColorBlock(block, out + 8);
+        break;
+    case Format::BC5:
+        encodeChannelBlock(block, 0, out);
+        encodeChannelBlock(block, 1, out + 8);
+        break;
+    }
+}
+
+// compresses an RGBA8 image; rows of blocks are spread over the pool when one is given
+inline std::vector<uint8_t> compress(
+    Format format, const uint8_t* rgba, int width, int height, ThreadPool* pool = nullptr)
+{
+    int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    size_t rowBytes = blocksX * blockBytes(format);
+    std::vector<uint8_t> out(rowBytes * blocksY);
+    auto encodeRow = [&](size_t by)
+    {
+        Block block;
+        uint8_t* dst = &out[by * rowBytes];
+        for (int bx = 0; bx < blocksX; ++bx)
+        {
+            fetchBlock(rgba, width, height, bx, (int)by, block);
+            encodeBlock(format, block, dst + bx * blockBytes(format));
+        }
+    };
+    // small levels aren't worth the scheduling overhead
+    if (pool && blocksX * blocksY >= 1024)
+        pool->parallelFor(blocksY, encodeRow);
+    else
+        for (int by = 0; by < blocksY; ++by)
+            encodeRow(by);
+    return out;
+}
+
+// next level of a mip chain: 2x2 box filter, edges clamped for odd sizes
+inline std::vector<uint8_t> downsample(const uint8_t* rgba, int width, int height)
+{
+    int w = std::max(1, width / 2), h = std::max(1, height / 2);
+    std::vector<uint8_t> out((size_t)w * h * 4);
+    for (int y = 0; y < h; ++y)
+    {
+        int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+        for (int x = 0; x < w; ++x)
+        {
+            int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            for (int c = 0; c < 4; ++c)
+            {
+                int sum = rgba[((size_t)y0 * width + x0) * 4 + c] +
+                          rgba[((size_t)y0 * width + x1) * 4 + c] +
+                          rgba[((size_t)y1 * width + x0) * 4 + c] +
+                          rgba[((size_t)y1 * width + x1) * 4 + c];
+                out[((size_t)y * w + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    }
+    return out;
+}
+
+}; // namespace bc
+}; // namespace rg
+#endif // PROJECT_BASE_BLOCKCOMPRESSION_H
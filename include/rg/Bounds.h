@@ -0,0 +1,91 @@
+#ifndef PROJECT_BASE_BOUNDS_H
+#define PROJECT_BASE_BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace rg
+{
+
+// Axis aligned box plus a bounding sphere around its center. The sphere is not minimal but
+// never larger than the box's half diagonal, and is what LOD selection works with; culling uses
+// the box.
+struct Bounds
+{
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(-1.0f); // empty until something is added
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    bool empty() const { return max.x < min.x; }
+
+    // VertexT needs a glm::vec3 Position
+    template <typename VertexT> static Bounds FromVertices(const std::vector<VertexT>& vertices)
+    {
+        Bounds bounds;
+        if (vertices.empty())
+            return bounds;
+        bounds.min = bounds.max = vertices[0].Position;
+        for (const VertexT& vertex : vertices)
+        {
+            bounds.min = glm::min(bounds.min, vertex.Position);
+            bounds.max = glm::max(bounds.max, vertex.Position);
+        }
+        bounds.center = (bounds.min + bounds.max) * 0.5f;
+        for (const VertexT& vertex : vertices)
+            bounds.radius = std::max(bounds.radius, glm::length(vertex.Position - bounds.center));
+        return bounds;
+    }
+
+    // grows the box over other, and the sphere over other's sphere
+    void merge(const Bounds& other)
+    {
+        if (other.empty())
+            return;
+        if (empty())
+        {
+            *this = other;
+            return;
+        }
+        glm::vec3 oldCenter = center;
+        float oldRadius = radius;
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+        center = (min + max) * 0.5f;
+        radius = std::max(
+            glm::length(oldCenter - center) + oldRadius,
+            glm::length(other.center - center) + other.radius);
+        radius = std::min(radius, glm::length(max - min) * 0.5f);
+    }
+
+    // bounds of the transformed box; the box is refit around the transformed corners (Arvo),
+    // the sphere scales with the largest axis
+    Bounds transformed(const glm::mat4& transform) const
+    {
+        Bounds result;
+        if (empty())
+            return result;
+        glm::vec3 translation(transform[3]);
+        result.min = result.max = translation;
+        for (int column = 0; column < 3; ++column)
+            for (int row = 0; row < 3; ++row)
+            {
+                float a = transform[column][row] * min[column];
+                float b = transform[column][row] * max[column];
+                result.min[row] += std::min(a, b);
+                result.max[row] += std::max(a, b);
+            }
+        result.center = glm::vec3(transform * glm::vec4(center, 1.0f));
+        float scale = std::max(
+            glm::length(glm::vec3(transform[0])),
+            std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+        result.radius = radius * scale;
+        return result;
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_BOUNDS_H
@@ -0,0 +1,501 @@
+#ifndef PROJECT_BASE_BVH_H
+#define PROJECT_BASE_BVH_H
+
+#include <glm/glm.hpp>
+
+#include <rg/Bounds.h>
+#include <rg/Frustum.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+namespace rg
+{
+
+struct Ray
+{
+    glm::vec3 origin = glm::vec3(0.0f);
+    glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f); // need not be normalized
+    float maxDistance = FLT_MAX;                        // in multiples of direction
+};
+
+struct RayHit
+{
+    unsigned int primitive = ~0u; // Bvh::NONE on a miss
+    float distance = FLT_MAX;
+};
+
+// Bounding volume hierarchy over primitive boxes (scene objects, meshes, anything with Bounds),
+// built top down with the binned surface area heuristic. Primitives are named by their index in
+// the vector handed to build(), and that is what the queries report.
+//
+// When primitives move, refit() recomputes the boxes bottom up and keeps the tree. That is
+// linear and allocation free, but the tree was split for the old positions; once cost() has
+// grown well past builtCost(), a rebuild pays off again.
+//
+// Queries are const and may run concurrently.
+class Bvh
+{
+  public:
+    static const unsigned int NONE = ~0u;
+    static const unsigned int MAX_LEAF_SIZE = 4;
+    static const unsigned int BINS = 16;
+    // deeper nodes are split at the object median, which bounds the traversal stacks
+    static const unsigned int SAH_DEPTH = 64;
+    static const unsigned int MAX_DEPTH = SAH_DEPTH + 32;
+
+    // interior nodes have count 0 and their children at first and first + 1; leaves hold
+    // primitives [first, first + count) of the leaf order
+    struct Node
+    {
+        glm::vec3 min;
+        unsigned int first;
+        glm::vec3 max;
+        unsigned int count;
+    };
+
+    void build(const std::vector<Bounds>& bounds)
+    {
+        unsigned int n = (unsigned int)bounds.size();
+        m_Nodes.clear();
+        m_Primitives.resize(n);
+        m_Boxes.resize(n);
+        m_Depth = 0;
+        m_BuiltCost = 0.0f;
+        if (n == 0)
+            return;
+
+        std::vector<glm::vec3> centroids(n);
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            m_Primitives[i] = i;
+            m_Boxes[i] = boxOf(bounds[i]);
+            centroids[i] = (m_Boxes[i].min + m_Boxes[i].max) * 0.5f;
+        }
+
+        // at most 2n - 1 nodes; reserving keeps references into m_Nodes valid while splitting
+        m_Nodes.reserve(2 * n - 1);
+        m_Nodes.push_back(Node{glm::vec3(0.0f), 0, glm::vec3(0.0f), n});
+        struct Task
+        {
+            unsigned int node;
+            unsigned int depth;
+        };
+        std::vector<Task> tasks;
+        tasks.push_back(Task{0, 1});
+        while (!tasks.empty())
+        {
+            Task task = tasks.back();
+            tasks.pop_back();
+            m_Depth = std::max(m_Depth, task.depth);
+            Node& node = m_Nodes[task.node];
+            Box box = emptyBox();
+            Box centroidBox = emptyBox();
+            for (unsigned int i = node.first; i < node.first + node.count; ++i)
+            {
+                unsigned int primitive = m_Primitives[i];
+                grow(box, m_Boxes[primitive]);
+                centroidBox.min = glm::min(centroidBox.min, centroids[primitive]);
+                centroidBox.max = glm::max(centroidBox.max, centroids[primitive]);
+            }
+            node.min = box.min;
+            node.max = box.max;
+            if (node.count <= MAX_LEAF_SIZE)
+                continue;
+
+            unsigned int first = node.first;
+            unsigned int count = node.count;
+            // an empty side means SAH found no split (or wasn't asked), fall back to the median
+            unsigned int middle = first;
+            if (task.depth < SAH_DEPTH)
+                middle = splitSah(first, count, centroidBox, centroids);
+            if (middle == first || middle == first + count)
+                middle = splitMedian(first, count, centroidBox, centroids);
+
+            unsigned int children = (unsigned int)m_Nodes.size();
+            node.first = children;
+            node.count = 0;
+            m_Nodes.push_back(Node{glm::vec3(0.0f), first, glm::vec3(0.0f), middle - first});
+            m_Nodes.push_back(
+                Node{glm::vec3(0.0f), middle, glm::vec3(0.0f), first + count - middle});
+            tasks.push_back(Task{children, task.depth + 1});
+            tasks.push_back(Task{children + 1, task.depth + 1});
+        }
+
+        // the leaf order is final, keep the boxes in it for the queries
+        std::vector<Box> ordered(n);
+        for (unsigned int i = 0; i < n; ++i)
+            ordered[i] = m_Boxes[m_Primitives[i]];
+        m_Boxes.swap(ordered);
+        m_BuiltCost = cost();
+    }
+
+    // bounds has to hold the same primitives, in the same order, as it did for build()
+    void refit(const std::vector<Bounds>& bounds)
+    {
+        for (size_t i = 0; i < m_Primitives.size(); ++i)
+            m_Boxes[i] = boxOf(bounds[m_Primitives[i]]);
+        // children are always created after their parent, so walking backwards sees them first
+        for (size_t i = m_Nodes.size(); i-- > 0;)
+        {
+            Node& node = m_Nodes[i];
+            Box box = emptyBox();
+            if (node.count)
+                for (unsigned int j = node.first; j < node.first + node.count; ++j)
+                    grow(box, m_Boxes[j]);
+            else
+            {
+                const Node& left = m_Nodes[node.first];
+                const Node& right = m_Nodes[node.first + 1];
+                box.min = glm::min(left.min, right.min);
+                box.max = glm::max(left.max, right.max);
+            }
+            node.min = box.min;
+            node.max = box.max;
+        }
+    }
+
+    // calls visit(primitive) for every primitive whose box is not entirely outside the frustum.
+    // Subtrees found fully inside a plane stop testing against it.
+    template <typename F> void queryFrustum(const Frustum& frustum, F&& visit) const
+    {
+        if (m_Nodes.empty())
+            return;
+        struct Entry
+        {
+            unsigned int node;
+            unsigned int planes; // bit per plane the subtree still straddles
+        };
+        Entry stack[MAX_DEPTH + 1];
+        unsigned int size = 0;
+        stack[size++] = Entry{0, 0x3f};
+        while (size)
+        {
+            Entry entry = stack[--size];
+            const Node& node = m_Nodes[entry.node];
+            unsigned int planes = entry.planes;
+            if (planes && !classify(frustum, node.min, node.max, planes))
+                continue;
+            if (node.count == 0)
+            {
+                stack[size++] = Entry{node.first + 1, planes};
+                stack[size++] = Entry{node.first, planes};
+                continue;
+            }
+            for (unsigned int i = node.first; i < node.first + node.count; ++i)
+            {
+                unsigned int primitivePlanes = planes;
+                if (!primitivePlanes ||
+                    classify(frustum, m_Boxes[i].min, m_Boxes[i].max, primitivePlanes))
+                    visit(m_Primitives[i]);
+            }
+        }
+    }
+
+    // closest primitive box along the ray
+    RayHit raycast(const Ray& ray) const
+    {
+        return raycast(ray, [](unsigned int, float entry) { return entry; });
+    }
+
+    // closest hit, with intersect(primitive, boxEntryDistance) deciding what a primitive whose
+    // box the ray enters actually hits: it returns the hit distance, or FLT_MAX for a miss. It
+    // is only asked about boxes entered before the closest hit so far.
+    template <typename F> RayHit raycast(const Ray& ray, F&& intersect) const
+    {
+        RayHit hit;
+        hit.distance = ray.maxDistance;
+        if (m_Nodes.empty())
+            return finishRay(hit);
+        glm::vec3 inverse = 1.0f / ray.direction;
+        struct Entry
+        {
+            unsigned int node;
+            float distance;
+        };
+        Entry stack[MAX_DEPTH + 1];
+        unsigned int size = 0;
+        float rootDistance = slabs(ray.origin, inverse, m_Nodes[0].min, m_Nodes[0].max);
+        if (rootDistance < hit.distance)
+            stack[size++] = Entry{0, rootDistance};
+        while (size)
+        {
+            Entry entry = stack[--size];
+            if (entry.distance >= hit.distance)
+                continue;
+            const Node& node = m_Nodes[entry.node];
+            if (node.count == 0)
+            {
+                const Node& left = m_Nodes[node.first];
+                const Node& right = m_Nodes[node.first + 1];
+                Entry nearer{node.first, slabs(ray.origin, inverse, left.min, left.max)};
+                Entry farther{node.first + 1, slabs(ray.origin, inverse, right.min, right.max)};
+                if (farther.distance < nearer.distance)
+                    std::swap(nearer, farther);
+                // the nearer child is popped first
+                if (farther.distance < hit.distance)
+                    stack[size++] = farther;
+                if (nearer.distance < hit.distance)
+                    stack[size++] = nearer;
+                continue;
+            }
+            for (unsigned int i = node.first; i < node.first + node.count; ++i)
+            {
+                float entryDistance = slabs(ray.origin, inverse, m_Boxes[i].min, m_Boxes[i].max);
+                if (entryDistance >= hit.distance)
+                    continue;
+                float distance = intersect(m_Primitives[i], entryDistance);
+                if (distance < hit.distance)
+                {
+                    hit.distance = distance;
+                    hit.primitive = m_Primitives[i];
+                }
+            }
+        }
+        return finishRay(hit);
+    }
+
+    // calls visit(primitive) for every primitive box overlapping box
+    template <typename F> void queryOverlap(const Bounds& box, F&& visit) const
+    {
+        query(
+            [&box](const glm::vec3& min, const glm::vec3& max)
+            {
+                return min.x <= box.max.x && max.x >= box.min.x && min.y <= box.max.y &&
+                       max.y >= box.min.y && min.z <= box.max.z && max.z >= box.min.z;
+            },
+            visit);
+    }
+
+    // calls visit(primitive) for every primitive box overlapping the sphere
+    template <typename F> void querySphere(const glm::vec3& center, float radius, F&& visit) const
+    {
+        float radius2 = radius * radius;
+        query(
+            [&center, radius2](const glm::vec3& min, const glm::vec3& max)
+            {
+                glm::vec3 offset = center - glm::clamp(center, min, max);
+                return glm::dot(offset, offset) <= radius2;
+            },
+            visit);
+    }
+
+    // SAH cost of the tree as it is now, relative to the root box: traversal steps plus box
+    // tests a random ray through the root is expected to take
+    float cost() const
+    {
+        if (m_Nodes.empty())
+            return 0.0f;
+        float rootArea = std::max(area(m_Nodes[0].min, m_Nodes[0].max), FLT_MIN);
+        float total = 0.0f;
+        for (const Node& node : m_Nodes)
+            total += area(node.min, node.max) / rootArea * (node.count ? node.count : 1.0f);
+        return total;
+    }
+    float builtCost() const { return m_BuiltCost; }
+
+    bool empty() const { return m_Nodes.empty(); }
+    size_t primitiveCount() const { return m_Primitives.size(); }
+    const std::vector<Node>& nodes() const { return m_Nodes; }
+    unsigned int depth() const { return m_Depth; }
+
+  private:
+    struct Box
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    std::vector<Node> m_Nodes;
+    // leaf order -> primitive index
+    std::vector<unsigned int> m_Primitives;
+    // primitive boxes; in input order while building, in leaf order afterwards
+    std::vector<Box> m_Boxes;
+    unsigned int m_Depth = 0;
+    float m_BuiltCost = 0.0f;
+
+    static Box boxOf(const Bounds& bounds) { return Box{bounds.min, bounds.max}; }
+
+    static float area(const glm::vec3& min, const glm::vec3& max)
+    {
+        glm::vec3 extent = glm::max(max - min, glm::vec3(0.0f));
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+
+    static Box emptyBox() { return Box{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)}; }
+
+    static void grow(Box& box, const Box& other)
+    {
+        box.min = glm::min(box.min, other.min);
+        box.max = glm::max(box.max, other.max);
+    }
+
+    // partitions the range at the cheapest of the bin boundaries on all three axes and returns
+    // the first index of the right half. All axes are binned in one pass over the range.
+    unsigned int splitSah(
+        unsigned int first, unsigned int count, const Box& centroidBox,
+        const std::vector<glm::vec3>& centroids)
+    {
+        glm::vec3 low = centroidBox.min;
+        glm::vec3 extent = centroidBox.max - centroidBox.min;
+        glm::vec3 scale;
+        for (int axis = 0; axis < 3; ++axis)
+            scale[axis] = extent[axis] > 0.0f ? BINS / extent[axis] : 0.0f;
+
+        unsigned int binCount[3][BINS] = {};
+        Box binBox[3][BINS];
+        for (Box(&axisBins)[BINS] : binBox)
+            for (Box& box : axisBins)
+                box = emptyBox();
+        for (unsigned int i = first; i < first + count; ++i)
+        {
+            unsigned int primitive = m_Primitives[i];
+            const glm::vec3& centroid = centroids[primitive];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                unsigned int bin = binOf(centroid[axis], low[axis], scale[axis]);
+                ++binCount[axis][bin];
+                grow(binBox[axis][bin], m_Boxes[primitive]);
+            }
+        }
+
+        int bestAxis = -1;
+        unsigned int bestBin = 0;
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (scale[axis] == 0.0f)
+                continue;
+            // sweep from the right, then evaluate every boundary from the left
+            float rightCost[BINS];
+            Box right = emptyBox();
+            unsigned int rightCount = 0;
+            for (unsigned int bin = BINS - 1; bin > 0; --bin)
+            {
+                grow(right, binBox[axis][bin]);
+                rightCount += binCount[axis][bin];
+                rightCost[bin] = rightCount ? rightCount * area(right.min, right.max) : 0.0f;
+            }
+            Box left = emptyBox();
+            unsigned int leftCount = 0;
+            for (unsigned int bin = 0; bin < BINS - 1; ++bin)
+            {
+                grow(left, binBox[axis][bin]);
+                leftCount += binCount[axis][bin];
+                if (leftCount == 0 || leftCount == count)
+                    continue;
+                float cost = leftCount * area(left.min, left.max) + rightCost[bin + 1];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = bin;
+                }
+            }
+        }
+        if (bestAxis < 0)
+            return first;
+
+        unsigned int* middle = std::partition(
+            m_Primitives.data() + first, m_Primitives.data() + first + count,
+            [&](unsigned int primitive)
+            {
+                return binOf(centroids[primitive][bestAxis], low[bestAxis], scale[bestAxis]) <=
+                       bestBin;
+            });
+        return (unsigned int)(middle - m_Primitives.data());
+    }
+
+    // splits the range in two equal halves along the longest centroid axis
+    unsigned int splitMedian(
+        unsigned int first, unsigned int count, const Box& centroidBox,
+        const std::vector<glm::vec3>& centroids)
+    {
+        glm::vec3 extent = centroidBox.max - centroidBox.min;
+        int axis =
+            extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        unsigned int* begin = m_Primitives.data() + first;
+        std::nth_element(
+            begin, begin + count / 2, begin + count, [&](unsigned int a, unsigned int b)
+            { return centroids[a][axis] < centroids[b][axis]; });
+        return first + count / 2;
+    }
+
+    static unsigned int binOf(float centroid, float low, float scale)
+    {
+        return std::min((unsigned int)((centroid - low) * scale), BINS - 1);
+    }
+
+    // false if the box is outside one of the planes; clears the bits of planes it is inside of
+    static bool classify(
+        const Frustum& frustum, const glm::vec3& min, const glm::vec3& max, unsigned int& planes)
+    {
+        for (unsigned int p = 0; p < 6; ++p)
+        {
+            if (!(planes & (1u << p)))
+                continue;
+            const glm::vec4& plane = frustum.planes[p];
+            glm::vec3 normal(plane);
+            glm::vec3 positive(
+                normal.x >= 0.0f ? max.x : min.x, normal.y >= 0.0f ? max.y : min.y,
+                normal.z >= 0.0f ? max.z : min.z);
+            if (glm::dot(normal, positive) + plane.w < 0.0f)
+                return false;
+            glm::vec3 negative(
+                normal.x >= 0.0f ? min.x : max.x, normal.y >= 0.0f ? min.y : max.y,
+                normal.z >= 0.0f ? min.z : max.z);
+            if (glm::dot(normal, negative) + plane.w >= 0.0f)
+                planes &= ~(1u << p);
+        }
+        return true;
+    }
+
+    // distance at which the ray enters the box, 0 if it starts inside, FLT_MAX if it misses
+    static float slabs(
+        const glm::vec3& origin, const glm::vec3& inverse, const glm::vec3& min,
+        const glm::vec3& max)
+    {
+        glm::vec3 t0 = (min - origin) * inverse;
+        glm::vec3 t1 = (max - origin) * inverse;
+        glm::vec3 entries = glm::min(t0, t1);
+        glm::vec3 exits = glm::max(t0, t1);
+        float enter = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+        float exit = std::min(std::min(exits.x, exits.y), exits.z);
+        return enter <= exit ? enter : FLT_MAX;
+    }
+
+    static RayHit finishRay(RayHit hit)
+    {
+        if (hit.primitive == NONE)
+            hit.distance = FLT_MAX;
+        return hit;
+    }
+
+    template <typename Overlaps, typename F> void query(Overlaps&& overlaps, F&& visit) const
+    {
+        if (m_Nodes.empty())
+            return;
+        unsigned int stack[MAX_DEPTH + 1];
+        unsigned int size = 0;
+        stack[size++] = 0;
+        while (size)
+        {
+            const Node& node = m_Nodes[stack[--size]];
+            if (!overlaps(node.min, node.max))
+                continue;
+            if (node.count == 0)
+            {
+                stack[size++] = node.first + 1;
+                stack[size++] = node.first;
+                continue;
+            }
+            for (unsigned int i = node.first; i < node.first + node.count; ++i)
+                if (overlaps(m_Boxes[i].min, m_Boxes[i].max))
+                    visit(m_Primitives[i]);
+        }
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_BVH_H
@@ -0,0 +1,70 @@
+#ifndef PROJECT_BASE_CAMERAPATH_H
+#define PROJECT_BASE_CAMERAPATH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace rg
+{
+
+// A closed camera flythrough: a Catmull-Rom spline through position keys, with the point looked
+// at following its own spline through the keys' targets. Keys are evenly spaced in time.
+class CameraPath
+{
+  public:
+    struct Key
+    {
+        glm::vec3 position;
+        glm::vec3 target;
+    };
+
+    CameraPath() = default;
+    explicit CameraPath(std::vector<Key> keys) : m_Keys(std::move(keys)) {}
+
+    bool empty() const { return m_Keys.empty(); }
+
+    // t in [0, 1) goes once around the loop, values outside wrap
+    Key sample(float t) const
+    {
+        if (m_Keys.size() < 2)
+            return m_Keys.empty() ? Key{glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f)} : m_Keys[0];
+        float segments = (float)m_Keys.size();
+        float position = (t - std::floor(t)) * segments;
+        int segment = std::min((int)position, (int)m_Keys.size() - 1);
+        float u = position - (float)segment;
+        const Key& k0 = key(segment - 1);
+        const Key& k1 = key(segment);
+        const Key& k2 = key(segment + 1);
+        const Key& k3 = key(segment + 2);
+        return Key{
+            catmullRom(k0.position, k1.position, k2.position, k3.position, u),
+            catmullRom(k0.target, k1.target, k2.target, k3.target, u)};
+    }
+
+  private:
+    std::vector<Key> m_Keys;
+
+    const Key& key(int index) const
+    {
+        int count = (int)m_Keys.size();
+        return m_Keys[((index % count) + count) % count];
+    }
+
+    // uniform Catmull-Rom between p1 and p2
+    static glm::vec3 catmullRom(
+        const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3,
+        float u)
+    {
+        float u2 = u * u;
+        float u3 = u2 * u;
+        return 0.5f * (2.0f * p1 + (p2 - p0) * u + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * u2 +
+                       (3.0f * p1 - p0 - 3.0f * p2 + p3) * u3);
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_CAMERAPATH_H
@@ -0,0 +1,152 @@
+#ifndef PROJECT_BASE_COMPRESSEDTEXTURECACHE_H
+#define PROJECT_BASE_COMPRESSEDTEXTURECACHE_H
+
+#include <rg/BlockCompression.h>
+#include <rg/MappedFile.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace rg
+{
+
+// block compressed image with its full mip chain, level 0 first
+struct CompressedImage
+{
+    struct Level
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<uint8_t> data;
+    };
+
+    bc::Format format = bc::Format::BC1;
+    std::vector<Level> levels;
+
+    size_t byteSize() const
+    {
+        size_t bytes = 0;
+        for (const Level& level : levels)
+            bytes += level.data.size();
+        return bytes;
+    }
+};
+
+// On-disk cache of cooked textures, stored next to the source image as <image>.bctex. An entry
+// is only used when it was cooked from a file with the same content hash and with the same
+// cooking flags (flip, target format family).
+class CompressedTextureCache
+{
+  public:
+    static const uint32_t VERSION = 1;
+
+    static std::string CachePathFor(const std::string& sourcePath)
+    {
+        return sourcePath + ".bctex";
+    }
+
+    static bool Load(
+        const std::string& sourcePath, uint64_t sourceHash, uint32_t flags, CompressedImage& image)
+    {
+        MappedFile file;
+        if (!file.open(CachePathFor(sourcePath)))
+            return false;
+        const unsigned char* pos = file.data();
+        const unsigned char* end = file.data() + file.size();
+
+        Header header;
+        if (!read(pos, end, &header, sizeof(header)) ||
+            std::memcmp(header.magic, "RGBC", 4) != 0 || header.version != VERSION ||
+            header.sourceHash != sourceHash || header.flags != flags || header.format > 2)
+            return false;
+
+        // sizes come from the file, so they are bounded before anything is allocated for them
+        if (header.levelCount == 0 || header.levelCount > MAX_LEVELS)
+            return false;
+        CompressedImage result;
+        result.format = (bc::Format)header.format;
+        result.levels.resize(header.levelCount);
+        for (CompressedImage::Level& level : result.levels)
+        {
+            uint32_t size[3];
+            if (!read(pos, end, size, sizeof(size)) || size[0] == 0 || size[1] == 0 ||
+                size[0] > MAX_SIZE || size[1] > MAX_SIZE ||
+                size[2] != bc::compressedSize(result.format, size[0], size[1]) ||
+                size[2] > (size_t)(end - pos))
+                return false;
+            level.width = size[0];
+            level.height = size[1];
+            level.data.resize(size[2]);
+            if (!read(pos, end, level.data.data(), size[2]))
+                return false;
+        }
+        image = std::move(result);
+        return true;
+    }
+
+    static void Store(
+        const std::string& sourcePath, uint64_t sourceHash, uint32_t flags,
+        const CompressedImage& image)
+    {
+        Header header;
+        std::memcpy(header.magic, "RGBC", 4);
+        header.version = VERSION;
+        header.format = (uint32_t)image.format;
+        header.flags = flags;
+        header.levelCount = image.levels.size();
+        header.sourceHash = sourceHash;
+
+        // write to a temporary file and rename it, so readers never see a partial cache
+        std::string cachePath = CachePathFor(sourcePath);
+        std::string tmpPath = cachePath + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (const CompressedImage::Level& level : image.levels)
+            {
+                uint32_t size[3] = {
+                    (uint32_t)level.width, (uint32_t)level.height, (uint32_t)level.data.size()};
+                out.write(reinterpret_cast<const char*>(size), sizeof(size));
+                out.write(reinterpret_cast<const char*>(level.data.data()), level.data.size());
+            }
+            if (!out)
+            {
+                std::remove(tmpPath.c_str());
+                return;
+            }
+        }
+        std::rename(tmpPath.c_str(), cachePath.c_str());
+    }
+
+  private:
+    // a full mip chain of the largest texture we accept
+    static const uint32_t MAX_LEVELS = 16;
+    static const uint32_t MAX_SIZE = 1u << (MAX_LEVELS - 1);
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t format;
+        uint32_t flags;
+        uint32_t levelCount;
+        uint32_t reserved = 0;
+        uint64_t sourceHash;
+    };
+
+    static bool read(const unsigned char*& pos, const unsigned char* end, void* out, size_t bytes)
+    {
+        if ((size_t)(end - pos) < bytes)
+            return false;
+        std::memcpy(out, pos, bytes);
+        pos += bytes;
+        return true;
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_COMPRESSEDTEXTURECACHE_H
@@ -0,0 +1,104 @@
+#ifndef PROJECT_BASE_FRUSTUM_H
+#define PROJECT_BASE_FRUSTUM_H
+
+#include <glm/glm.hpp>
+#include <rg/Bounds.h>
+
+namespace rg
+{
+
+// The six planes of a view frustum, pointing inwards, in the space the matrix maps from
+// (world space for projection * view).
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    // Gribb & Hartmann: each plane is the last row of the matrix plus or minus one of the others
+    static Frustum FromMatrix(const glm::mat4& m)
+    {
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; ++i)
+            row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+        Frustum frustum;
+        frustum.planes[0] = row[3] + row[0]; // left
+        frustum.planes[1] = row[3] - row[0]; // right
+        frustum.planes[2] = row[3] + row[1]; // bottom
+        frustum.planes[3] = row[3] - row[1]; // top
+        frustum.planes[4] = row[3] + row[2]; // near
+        frustum.planes[5] = row[3] - row[2]; // far
+        for (glm::vec4& plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    // false only if the box is entirely outside one plane; boxes near a corner may pass
+    bool intersects(const Bounds& box) const
+    {
+        for (const glm::vec4& plane : planes)
+        {
+            // the corner furthest along the plane normal
+            glm::vec3 positive(
+                plane.x >= 0.0f ? box.max.x : box.min.x, plane.y >= 0.0f ? box.max.y : box.min.y,
+                plane.z >= 0.0f ? box.max.z : box.min.z);
+            if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    bool intersects(const glm::vec3& center, float radius) const
+    {
+        for (const glm::vec4& plane : planes)
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        return true;
+    }
+};
+
+// what frustum culling kept and dropped, reset every frame
+struct CullStats
+{
+    unsigned int meshesDrawn = 0;
+    unsigned int meshesCulled = 0;
+    unsigned int modelsCulled = 0;
+
+    void reset() { *this = CullStats(); }
+};
+
+// Frustum test for world space bounds, counting into stats. Disabled culling passes everything.
+struct FrustumCuller
+{
+    Frustum frustum;
+    bool enabled = true;
+    CullStats* stats = nullptr;
+
+    FrustumCuller() = default;
+    FrustumCuller(const glm::mat4& viewProjection, bool enabled, CullStats* stats = nullptr)
+        : frustum(Frustum::FromMatrix(viewProjection)), enabled(enabled), stats(stats)
+    {
+    }
+
+    // a whole model; meshCount meshes are counted as culled when it is outside
+    bool visibleModel(const Bounds& world, unsigned int meshCount) const
+    {
+        if (!enabled || frustum.intersects(world))
+            return true;
+        if (stats)
+        {
+            ++stats->modelsCulled;
+            stats->meshesCulled += meshCount;
+        }
+        return false;
+    }
+
+    bool visible(const Bounds& world) const
+    {
+        bool inside = !enabled || frustum.intersects(world);
+        if (stats)
+            ++(inside ? stats->meshesDrawn : stats->meshesCulled);
+        return inside;
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_FRUSTUM_H
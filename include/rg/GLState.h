@@ -0,0 +1,280 @@
+#ifndef PROJECT_BASE_GLSTATE_H
+#define PROJECT_BASE_GLSTATE_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+namespace rg
+{
+
+// Shadow copy of the GL state that rendering changes most: program, vertex array, texture units,
+// the culling/depth test/blending switches and the depth mask and function. Calls that would set
+// what is already in effect are skipped. Everything starts out unknown, so the first call of
+// each kind always reaches GL.
+//
+// Code that changes tracked state behind its back (ImGui, object deletion) calls invalidate() or
+// the *Deleted() functions afterwards. With verify on, every skipped call is first checked
+// against glGet*, and a stale cache is reported and corrected; define RG_VERIFY_GL_STATE to have
+// it on from the start.
+class GLState
+{
+  public:
+    static const unsigned int MAX_UNITS = 16;
+
+    struct Counter
+    {
+        unsigned int issued = 0;
+        unsigned int elided = 0;
+    };
+
+    struct Stats
+    {
+        Counter programs;
+        Counter vertexArrays;
+        Counter activeTextures;
+        Counter textures;
+        Counter capabilities; // glEnable / glDisable
+        Counter depth;        // glDepthMask / glDepthFunc
+        unsigned int mismatches = 0;
+
+        unsigned int issued() const
+        {
+            return programs.issued + vertexArrays.issued + activeTextures.issued +
+                   textures.issued + capabilities.issued + depth.issued;
+        }
+        unsigned int elided() const
+        {
+            return programs.elided + vertexArrays.elided + activeTextures.elided +
+                   textures.elided + capabilities.elided + depth.elided;
+        }
+    };
+
+    static GLState& Instance()
+    {
+        static GLState instance;
+        return instance;
+    }
+
+    void useProgram(unsigned int program)
+    {
+        if (m_Program == program && check(GL_CURRENT_PROGRAM, program, "program"))
+        {
+            ++m_Stats.programs.elided;
+            return;
+        }
+        glUseProgram(program);
+        m_Program = program;
+        ++m_Stats.programs.issued;
+    }
+
+    void bindVertexArray(unsigned int vao)
+    {
+        if (m_VertexArray == vao && check(GL_VERTEX_ARRAY_BINDING, vao, "vertex array"))
+        {
+            ++m_Stats.vertexArrays.elided;
+            return;
+        }
+        glBindVertexArray(vao);
+        m_VertexArray = vao;
+        ++m_Stats.vertexArrays.issued;
+    }
+
+    // unit is an index, not GL_TEXTUREi
+    void activeTexture(unsigned int unit)
+    {
+        if (m_ActiveUnit == unit &&
+            check(GL_ACTIVE_TEXTURE, GL_TEXTURE0 + unit, "active texture unit"))
+        {
+            ++m_Stats.activeTextures.elided;
+            return;
+        }
+        glActiveTexture(GL_TEXTURE0 + unit);
+        m_ActiveUnit = unit;
+        ++m_Stats.activeTextures.issued;
+    }
+
+    // binds to the active unit; only GL_TEXTURE_2D and GL_TEXTURE_CUBE_MAP are tracked
+    void bindTexture(GLenum target, unsigned int texture)
+    {
+        unsigned int* bound = boundTexture(target);
+        if (bound && *bound == texture &&
+            check(bindingQuery(target), texture, "texture binding"))
+        {
+            ++m_Stats.textures.elided;
+            return;
+        }
+        glBindTexture(target, texture);
+        if (bound)
+            *bound = texture;
+        ++m_Stats.textures.issued;
+    }
+
+    void bindTexture(unsigned int unit, GLenum target, unsigned int texture)
+    {
+        activeTexture(unit);
+        bindTexture(target, texture);
+    }
+
+    // GL_CULL_FACE, GL_DEPTH_TEST and GL_BLEND are tracked, anything else goes straight to GL
+    void setEnabled(GLenum capability, bool enabled)
+    {
+        int* current = capabilityState(capability);
+        if (current && *current == (int)enabled && checkEnabled(capability, enabled))
+        {
+            ++m_Stats.capabilities.elided;
+            return;
+        }
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+        if (current)
+            *current = enabled;
+        ++m_Stats.capabilities.issued;
+    }
+    void enable(GLenum capability) { setEnabled(capability, true); }
+    void disable(GLenum capability) { setEnabled(capability, false); }
+
+    void depthMask(bool write)
+    {
+        if (m_DepthMask == (int)write && check(GL_DEPTH_WRITEMASK, write, "depth mask"))
+        {
+            ++m_Stats.depth.elided;
+            return;
+        }
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        m_DepthMask = write;
+        ++m_Stats.depth.issued;
+    }
+
+    void depthFunc(GLenum func)
+    {
+        if (m_DepthFunc == func && check(GL_DEPTH_FUNC, func, "depth function"))
+        {
+            ++m_Stats.depth.elided;
+            return;
+        }
+        glDepthFunc(func);
+        m_DepthFunc = func;
+        ++m_Stats.depth.issued;
+    }
+
+    // forget everything, the next call of each kind is issued
+    void invalidate() { *this = GLState(m_Verify, m_Stats); }
+
+    // GL unbinds deleted objects; without this a new object reusing the name would be skipped
+    void vertexArrayDeleted(unsigned int vao)
+    {
+        if (m_VertexArray == vao)
+            m_VertexArray = 0;
+    }
+    void textureDeleted(unsigned int texture)
+    {
+        for (unsigned int unit = 0; unit < MAX_UNITS; ++unit)
+            for (unsigned int& bound : m_Textures[unit])
+                if (bound == texture)
+                    bound = 0;
+    }
+
+    void setVerify(bool verify) { m_Verify = verify; }
+    bool verifying() const { return m_Verify; }
+
+    const Stats& stats() const { return m_Stats; }
+    void resetStats() { m_Stats = Stats(); }
+
+  private:
+    static const unsigned int UNKNOWN = ~0u;
+
+    unsigned int m_Program = UNKNOWN;
+    unsigned int m_VertexArray = UNKNOWN;
+    unsigned int m_ActiveUnit = UNKNOWN;
+    // per unit: GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP
+    unsigned int m_Textures[MAX_UNITS][2];
+    // GL_CULL_FACE, GL_DEPTH_TEST, GL_BLEND: 0 / 1, -1 unknown
+    int m_Capabilities[3] = {-1, -1, -1};
+    int m_DepthMask = -1;
+    GLenum m_DepthFunc = UNKNOWN;
+#ifdef RG_VERIFY_GL_STATE
+    bool m_Verify = true;
+#else
+    bool m_Verify = false;
+#endif
+    Stats m_Stats;
+
+    GLState()
+    {
+        for (unsigned int unit = 0; unit < MAX_UNITS; ++unit)
+            m_Textures[unit][0] = m_Textures[unit][1] = UNKNOWN;
+    }
+    GLState(bool verify, const Stats& stats) : GLState()
+    {
+        m_Verify = verify;
+        m_Stats = stats;
+    }
+
+    unsigned int* boundTexture(GLenum target)
+    {
+        if (m_ActiveUnit >= MAX_UNITS)
+            return nullptr;
+        if (target == GL_TEXTURE_2D)
+            return &m_Textures[m_ActiveUnit][0];
+        if (target == GL_TEXTURE_CUBE_MAP)
+            return &m_Textures[m_ActiveUnit][1];
+        return nullptr;
+    }
+
+    static GLenum bindingQuery(GLenum target)
+    {
+        return target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_BINDING_CUBE_MAP : GL_TEXTURE_BINDING_2D;
+    }
+
+    int* capabilityState(GLenum capability)
+    {
+        switch (capability)
+        {
+        case GL_CULL_FACE:
+            return &m_Capabilities[0];
+        case GL_DEPTH_TEST:
+            return &m_Capabilities[1];
+        case GL_BLEND:
+            return &m_Capabilities[2];
+        default:
+            return nullptr;
+        }
+    }
+
+    // true if verification is off or GL agrees with the cache; otherwise the call is issued
+    bool check(GLenum query, unsigned int expected, const char* what)
+    {
+        if (!m_Verify)
+            return true;
+        GLint actual = 0;
+        glGetIntegerv(query, &actual);
+        if ((unsigned int)actual == expected)
+            return true;
+        reportMismatch(what, actual, expected);
+        return false;
+    }
+
+    bool checkEnabled(GLenum capability, bool expected)
+    {
+        if (!m_Verify)
+            return true;
+        bool actual = glIsEnabled(capability) == GL_TRUE;
+        if (actual == expected)
+            return true;
+        reportMismatch("capability", actual, expected);
+        return false;
+    }
+
+    void reportMismatch(const char* what, GLint actual, unsigned int expected)
+    {
+        ++m_Stats.mismatches;
+        std::cout << "ERROR::GL_STATE:: " << what << " is " << actual << ", cached " << expected
+                  << std::endl;
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_GLSTATE_H
@@ -0,0 +1,360 @@
+#ifndef PROJECT_BASE_GEOMETRYPOOL_H
+#define PROJECT_BASE_GEOMETRYPOOL_H
+
+#include <glad/glad.h>
+
+#include <rg/GLState.h>
+#include <rg/InstanceBuffer.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <map>
+
+namespace rg
+{
+
+// Best-fit allocator of [offset, offset + size) ranges inside a growable capacity. Free ranges
+// are kept sorted by offset and merged with their neighbours when released.
+class RangeAllocator
+{
+  public:
+    explicit RangeAllocator(size_t capacity = 0) { grow(capacity); }
+
+    bool allocate(size_t size, size_t& offset)
+    {
+        if (size == 0)
+        {
+            offset = 0;
+            return true;
+        }
+        auto best = m_Free.end();
+        for (auto it = m_Free.begin(); it != m_Free.end(); ++it)
+        {
+            if (it->second >= size && (best == m_Free.end() || it->second < best->second))
+                best = it;
+        }
+        if (best == m_Free.end())
+            return false;
+
+        offset = best->first;
+        size_t remaining = best->second - size;
+        m_Free.erase(best);
+        if (remaining > 0)
+            m_Free.emplace(offset + size, remaining);
+        m_Used += size;
+        return true;
+    }
+
+    void free(size_t offset, size_t size)
+    {
+        if (size == 0)
+            return;
+        m_Used -= size;
+        auto next = m_Free.lower_bound(offset);
+        if (next != m_Free.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = m_Free.erase(next);
+        }
+        if (next != m_Free.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                previous->second += size;
+                return;
+            }
+        }
+        m_Free.emplace(offset, size);
+    }
+
+    // appends [capacity, newCapacity) as free space
+    void grow(size_t newCapacity)
+    {
+        if (newCapacity <= m_Capacity)
+            return;
+        size_t added = newCapacity - m_Capacity;
+        size_t offset = m_Capacity;
+        m_Capacity = newCapacity;
+        m_Used += added; // free() subtracts it again
+        free(offset, added);
+    }
+
+    void reset()
+    {
+        m_Free.clear();
+        m_Capacity = m_Used = 0;
+    }
+
+    size_t capacity() const { return m_Capacity; }
+    size_t used() const { return m_Used; }
+    size_t freeBlocks() const { return m_Free.size(); }
+    size_t largestFreeBlock() const
+    {
+        size_t largest = 0;
+        for (const auto& block : m_Free)
+            largest = std::max(largest, block.second);
+        return largest;
+    }
+    // 0 when all free space is one block, close to 1 when it is scattered in small pieces
+    float fragmentation() const
+    {
+        size_t freeSpace = m_Capacity - m_Used;
+        return freeSpace ? 1.0f - (float)largestFreeBlock() / freeSpace : 0.0f;
+    }
+    // end of the highest allocated range
+    size_t highWaterMark() const
+    {
+        if (m_Free.empty())
+            return m_Capacity;
+        auto last = std::prev(m_Free.end());
+        return last->first + last->second == m_Capacity ? last->first : m_Capacity;
+    }
+
+  private:
+    std::map<size_t, size_t> m_Free; // offset -> size
+    size_t m_Capacity = 0;
+    size_t m_Used = 0;
+};
+
+inline size_t indexSize(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+}
+
+// vertex and index ranges of one mesh inside a GeometryPool
+struct GeometryAllocation
+{
+    unsigned int baseVertex = 0;
+    unsigned int vertexCount = 0;
+    unsigned int indexByteOffset = 0;
+    unsigned int indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+};
+
+// Shared vertex and index buffer for all meshes of one vertex layout, drawn through a single VAO
+// with glDrawElementsBaseVertex. Indices stay relative to the mesh's own vertices, and may be 16
+// or 32 bit per mesh; the index buffer is handed out in 4 byte words so either type is aligned.
+// Both buffers grow by copying into a larger buffer when an allocation doesn't fit.
+//
+// GL objects are created on the first allocation; only used from the thread that owns the GL
+// context.
+class GeometryPool
+{
+  public:
+    struct Stats
+    {
+        unsigned int allocations = 0;
+        unsigned int shortIndexAllocations = 0; // meshes with GL_UNSIGNED_SHORT indices
+        size_t vertexBytes = 0, vertexCapacityBytes = 0;
+        size_t indexBytes = 0, indexCapacityBytes = 0;
+        size_t vertexFreeBlocks = 0, indexFreeBlocks = 0;
+        float vertexFragmentation = 0.0f, indexFragmentation = 0.0f;
+    };
+
+    // setupAttributes is called with the VAO and vertex buffer bound, offsets relative to 0
+    GeometryPool(
+        GLsizei vertexStride, void (*setupAttributes)(), size_t initialVertices = 1 << 16,
+        size_t initialIndexWords = 1 << 18)
+        : m_VertexStride(vertexStride), m_SetupAttributes(setupAttributes),
+          m_InitialVertices(initialVertices), m_InitialIndexWords(initialIndexWords)
+    {
+    }
+
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+
+    ~GeometryPool() = default; // GL objects go with destroy(), the context may be gone by now
+
+    // indexType is GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GeometryAllocation allocate(
+        const void* vertices, size_t vertexCount, const void* indices, size_t indexCount,
+        GLenum indexType)
+    {
+        if (!m_VAO)
+            create();
+
+        size_t indexBytes = indexCount * indexSize(indexType);
+        size_t indexWords = (indexBytes + INDEX_WORD - 1) / INDEX_WORD;
+        size_t baseVertex, firstWord;
+        while (!m_Vertices.allocate(vertexCount, baseVertex))
+            growVertices(vertexCount);
+        while (!m_Indices.allocate(indexWords, firstWord))
+            growIndices(indexWords);
+
+        // upload through the copy target, so the currently bound VAO keeps its element buffer
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_VBO);
+        glBufferSubData(
+            GL_COPY_WRITE_BUFFER, baseVertex * m_VertexStride, vertexCount * m_VertexStride,
+            vertices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, firstWord * INDEX_WORD, indexBytes, indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        ++m_Allocations;
+        if (indexType == GL_UNSIGNED_SHORT)
+            ++m_ShortIndexAllocations;
+        GeometryAllocation allocation;
+        allocation.baseVertex = (unsigned int)baseVertex;
+        allocation.vertexCount = (unsigned int)vertexCount;
+        allocation.indexByteOffset = (unsigned int)(firstWord * INDEX_WORD);
+        allocation.indexCount = (unsigned int)indexCount;
+        allocation.indexType = indexType;
+        return allocation;
+    }
+
+    // ignored after destroy()
+    void free(const GeometryAllocation& allocation)
+    {
+        if (!m_VAO)
+            return;
+        m_Vertices.free(allocation.baseVertex, allocation.vertexCount);
+        size_t indexBytes = allocation.indexCount * indexSize(allocation.indexType);
+        m_Indices.free(
+            allocation.indexByteOffset / INDEX_WORD, (indexBytes + INDEX_WORD - 1) / INDEX_WORD);
+        --m_Allocations;
+        if (allocation.indexType == GL_UNSIGNED_SHORT)
+            --m_ShortIndexAllocations;
+    }
+
+    // deletes the buffers regardless of live allocations, for shutdown
+    void destroy()
+    {
+        if (!m_VAO)
+            return;
+        glDeleteVertexArrays(1, &m_VAO);
+        GLState::Instance().vertexArrayDeleted(m_VAO);
+        if (m_InstancedVAO)
+        {
+            glDeleteVertexArrays(1, &m_InstancedVAO);
+            GLState::Instance().vertexArrayDeleted(m_InstancedVAO);
+        }
+        glDeleteBuffers(1, &m_VBO);
+        glDeleteBuffers(1, &m_EBO);
+        m_VAO = m_InstancedVAO = m_VBO = m_EBO = 0;
+        m_Instances = nullptr;
+        m_Vertices.reset();
+        m_Indices.reset();
+        m_Allocations = m_ShortIndexAllocations = 0;
+    }
+
+    unsigned int vao() const { return m_VAO; }
+
+    // a second VAO over the same buffers that also reads a per-instance matrix from instances,
+    // for glDrawElementsInstancedBaseVertex
+    unsigned int instancedVao(InstanceBuffer& instances)
+    {
+        if (!m_VAO)
+            create();
+        if (!m_InstancedVAO)
+            glGenVertexArrays(1, &m_InstancedVAO);
+        if (m_Instances != &instances)
+        {
+            m_Instances = &instances;
+            setupVertexArray();
+        }
+        return m_InstancedVAO;
+    }
+
+    Stats stats() const
+    {
+        Stats stats;
+        stats.allocations = m_Allocations;
+        stats.shortIndexAllocations = m_ShortIndexAllocations;
+        stats.vertexBytes = m_Vertices.used() * m_VertexStride;
+        stats.vertexCapacityBytes = m_Vertices.capacity() * m_VertexStride;
+        stats.indexBytes = m_Indices.used() * INDEX_WORD;
+        stats.indexCapacityBytes = m_Indices.capacity() * INDEX_WORD;
+        stats.vertexFreeBlocks = m_Vertices.freeBlocks();
+        stats.indexFreeBlocks = m_Indices.freeBlocks();
+        stats.vertexFragmentation = m_Vertices.fragmentation();
+        stats.indexFragmentation = m_Indices.fragmentation();
+        return stats;
+    }
+
+  private:
+    static const size_t INDEX_WORD = 4;
+
+    GLsizei m_VertexStride;
+    void (*m_SetupAttributes)();
+    size_t m_InitialVertices, m_InitialIndexWords;
+    unsigned int m_VAO = 0, m_VBO = 0, m_EBO = 0;
+    unsigned int m_InstancedVAO = 0;
+    InstanceBuffer* m_Instances = nullptr;
+    RangeAllocator m_Vertices, m_Indices;
+    unsigned int m_Allocations = 0;
+    unsigned int m_ShortIndexAllocations = 0;
+
+    void create()
+    {
+        glGenVertexArrays(1, &m_VAO);
+        glGenBuffers(1, &m_VBO);
+        glGenBuffers(1, &m_EBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_VBO);
+        glBufferData(
+            GL_COPY_WRITE_BUFFER, m_InitialVertices * m_VertexStride, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_EBO);
+        glBufferData(
+            GL_COPY_WRITE_BUFFER, m_InitialIndexWords * INDEX_WORD, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        m_Vertices.grow(m_InitialVertices);
+        m_Indices.grow(m_InitialIndexWords);
+        setupVertexArray();
+    }
+
+    void setupVertexArray()
+    {
+        GLint previous;
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous);
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        m_SetupAttributes();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+        if (m_InstancedVAO && m_Instances)
+        {
+            glBindVertexArray(m_InstancedVAO);
+            glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+            m_SetupAttributes();
+            m_Instances->setupAttributes();
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+        }
+        glBindVertexArray(previous);
+    }
+
+    // copies the used prefix of buffer into a new buffer of newBytes
+    static void reallocate(unsigned int& buffer, size_t usedBytes, size_t newBytes)
+    {
+        unsigned int grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        if (usedBytes)
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        buffer = grown;
+    }
+
+    void growVertices(size_t needed)
+    {
+        size_t capacity = std::max(m_Vertices.capacity() * 2, m_Vertices.capacity() + needed);
+        reallocate(
+            m_VBO, m_Vertices.highWaterMark() * m_VertexStride, capacity * m_VertexStride);
+        m_Vertices.grow(capacity);
+        setupVertexArray();
+    }
+
+    void growIndices(size_t needed)
+    {
+        size_t capacity = std::max(m_Indices.capacity() * 2, m_Indices.capacity() + needed);
+        reallocate(m_EBO, m_Indices.highWaterMark() * INDEX_WORD, capacity * INDEX_WORD);
+        m_Indices.grow(capacity);
+        setupVertexArray();
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_GEOMETRYPOOL_H
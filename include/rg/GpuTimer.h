@@ -0,0 +1,194 @@
+#ifndef PROJECT_BASE_GPUTIMER_H
+#define PROJECT_BASE_GPUTIMER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+
+namespace rg
+{
+
+// GPU and CPU time of the sections of a frame. Each section is bracketed by two GL_TIMESTAMP
+// queries, and the whole frame by a GL_TIME_ELAPSED query; timestamps are used for sections
+// because elapsed queries cannot nest inside the frame's. The CPU time of a section is the time
+// spent submitting it.
+//
+// Queries live in a ring of FRAMES frames. A frame's results are read when its slot comes around
+// again, and only if they are all available, so the GPU is never waited on; a frame whose results
+// are still pending by then is dropped.
+class GpuTimer
+{
+  public:
+    static const unsigned int FRAMES = 4;
+    static const unsigned int MAX_SECTIONS = 16;
+
+    struct Section
+    {
+        const char* name = "";
+        double cpuMs = 0.0;
+        double gpuMs = 0.0;
+    };
+
+    struct Frame
+    {
+        Section sections[MAX_SECTIONS];
+        unsigned int count = 0;
+        double cpuMs = 0.0;
+        double gpuMs = 0.0;
+    };
+
+    // brackets a scope as a section; sections do not nest
+    class Scope
+    {
+      public:
+        Scope(GpuTimer& timer, const char* name) : m_Timer(timer) { m_Timer.begin(name); }
+        ~Scope() { m_Timer.end(); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        GpuTimer& m_Timer;
+    };
+
+    GpuTimer() = default;
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void create()
+    {
+        for (Slot& slot : m_Slots)
+        {
+            glGenQueries(2 * MAX_SECTIONS, slot.timestamps);
+            glGenQueries(1, &slot.elapsed);
+        }
+        m_Created = true;
+    }
+
+    void destroy()
+    {
+        if (!m_Created)
+            return;
+        for (Slot& slot : m_Slots)
+        {
+            glDeleteQueries(2 * MAX_SECTIONS, slot.timestamps);
+            glDeleteQueries(1, &slot.elapsed);
+            slot.pending = false;
+        }
+        m_Created = false;
+    }
+
+    void beginFrame()
+    {
+        if (!m_Created)
+            return;
+        Slot& slot = m_Slots[m_Next];
+        if (slot.pending && !collect(slot))
+            ++m_Dropped;
+        slot.frame = Frame();
+        slot.pending = false;
+        m_Current = &slot;
+        m_FrameStart = Clock::now();
+        glBeginQuery(GL_TIME_ELAPSED, slot.elapsed);
+    }
+
+    // starts a section, ending the one that is open; name has static storage
+    void begin(const char* name)
+    {
+        if (!m_Current)
+            return;
+        end();
+        Frame& frame = m_Current->frame;
+        if (frame.count == MAX_SECTIONS)
+            return;
+        glQueryCounter(m_Current->timestamps[2 * frame.count], GL_TIMESTAMP);
+        frame.sections[frame.count].name = name;
+        m_SectionStart = Clock::now();
+        m_Open = true;
+    }
+
+    void end()
+    {
+        if (!m_Open)
+            return;
+        Frame& frame = m_Current->frame;
+        glQueryCounter(m_Current->timestamps[2 * frame.count + 1], GL_TIMESTAMP);
+        frame.sections[frame.count].cpuMs = millisecondsSince(m_SectionStart);
+        ++frame.count;
+        m_Open = false;
+    }
+
+    void endFrame()
+    {
+        if (!m_Current)
+            return;
+        end();
+        glEndQuery(GL_TIME_ELAPSED);
+        m_Current->frame.cpuMs = millisecondsSince(m_FrameStart);
+        m_Current->pending = true;
+        m_Current = nullptr;
+        m_Next = (m_Next + 1) % FRAMES;
+    }
+
+    // the newest frame whose results have come back, FRAMES frames old
+    const Frame& latest() const { return m_Latest; }
+    // frames whose results were not back when their queries were needed again
+    unsigned int dropped() const { return m_Dropped; }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Slot
+    {
+        GLuint timestamps[2 * MAX_SECTIONS] = {};
+        GLuint elapsed = 0;
+        bool pending = false;
+        Frame frame;
+    };
+
+    Slot m_Slots[FRAMES];
+    unsigned int m_Next = 0;
+    Slot* m_Current = nullptr;
+    bool m_Open = false;
+    bool m_Created = false;
+    unsigned int m_Dropped = 0;
+    Clock::time_point m_FrameStart;
+    Clock::time_point m_SectionStart;
+    Frame m_Latest;
+
+    static bool available(GLuint query)
+    {
+        GLuint result = GL_FALSE;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &result);
+        return result != GL_FALSE;
+    }
+
+    // reads the slot's results into m_Latest if every one of them is available
+    bool collect(Slot& slot)
+    {
+        if (!available(slot.elapsed))
+            return false;
+        for (unsigned int i = 0; i < 2 * slot.frame.count; ++i)
+            if (!available(slot.timestamps[i]))
+                return false;
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(slot.elapsed, GL_QUERY_RESULT, &elapsed);
+        slot.frame.gpuMs = (double)elapsed / 1e6;
+        for (unsigned int i = 0; i < slot.frame.count; ++i)
+        {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(slot.timestamps[2 * i], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(slot.timestamps[2 * i + 1], GL_QUERY_RESULT, &end);
+            slot.frame.sections[i].gpuMs = end > begin ? (double)(end - begin) / 1e6 : 0.0;
+        }
+        m_Latest = slot.frame;
+        return true;
+    }
+
+    static double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_GPUTIMER_H
@@ -0,0 +1,33 @@
+#ifndef PROJECT_BASE_HASH_H
+#define PROJECT_BASE_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace rg
+{
+
+const uint64_t FNV1A64_OFFSET = 14695981039346656037ull;
+const uint64_t FNV1A64_PRIME = 1099511628211ull;
+
+// 64-bit FNV-1a. Not cryptographic, but plenty for detecting changed or duplicated asset files.
+inline uint64_t fnv1a64(const void* data, size_t size, uint64_t seed = FNV1A64_OFFSET)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV1A64_PRIME;
+    }
+    return hash;
+}
+
+inline uint64_t fnv1a64(const std::string& str, uint64_t seed = FNV1A64_OFFSET)
+{
+    return fnv1a64(str.data(), str.size(), seed);
+}
+
+}; // namespace rg
+#endif // PROJECT_BASE_HASH_H
@@ -0,0 +1,171 @@
+#ifndef PROJECT_BASE_HEADLESSCONTEXT_H
+#define PROJECT_BASE_HEADLESSCONTEXT_H
+
+#include <glad/glad.h>
+
+// RG_HEADLESS_EGL is defined by the build when EGL was found; without it the context below
+// fails to create and --bench reports that
+#ifdef RG_HEADLESS_EGL
+// no window system is used, so keep eglplatform.h from pulling in Xlib and its macros
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <iostream>
+
+namespace rg
+{
+
+#ifdef RG_HEADLESS_EGL
+
+// An OpenGL 3.3 core context without a window, for running the renderer where there is no
+// display: EGL on Mesa's surfaceless platform (llvmpipe on a CI box works), falling back to the
+// default display. Nothing is presented; frames go into a framebuffer object of the requested
+// size, which is left bound as the draw framebuffer.
+class HeadlessContext
+{
+  public:
+    HeadlessContext() = default;
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+    ~HeadlessContext() { destroy(); }
+
+    // makes the context current and loads glad through it; false if any step fails
+    bool create(unsigned int width, unsigned int height)
+    {
+        if (!createContext())
+        {
+            destroy();
+            return false;
+        }
+        if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+        {
+            std::cout << "HEADLESS:: failed to initialize GLAD" << std::endl;
+            destroy();
+            return false;
+        }
+        glGenFramebuffers(1, &m_Framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+        glGenRenderbuffers(2, m_Renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_Renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(
+            GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_Renderbuffers[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_Renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(
+            GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_Renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "HEADLESS:: framebuffer incomplete" << std::endl;
+            destroy();
+            return false;
+        }
+        glViewport(0, 0, width, height);
+        std::cout << "HEADLESS:: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION)
+                  << std::endl;
+        return true;
+    }
+
+    void destroy()
+    {
+        if (m_Context == EGL_NO_CONTEXT)
+            return;
+        if (m_Framebuffer)
+        {
+            glDeleteFramebuffers(1, &m_Framebuffer);
+            glDeleteRenderbuffers(2, m_Renderbuffers);
+            m_Framebuffer = 0;
+        }
+        eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(m_Display, m_Context);
+        eglTerminate(m_Display);
+        m_Context = EGL_NO_CONTEXT;
+        m_Display = EGL_NO_DISPLAY;
+    }
+
+    // the function loader of the context, for what else loads GL entry points
+    static GLADloadproc GetProcAddress() { return (GLADloadproc)eglGetProcAddress; }
+
+  private:
+    EGLDisplay m_Display = EGL_NO_DISPLAY;
+    EGLContext m_Context = EGL_NO_CONTEXT;
+    GLuint m_Framebuffer = 0;
+    GLuint m_Renderbuffers[2] = {};
+
+    bool createContext()
+    {
+        // eglGetPlatformDisplayEXT is only there with EGL_EXT_platform_base
+        auto getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            m_Display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, nullptr, nullptr);
+        EGLint major = 0, minor = 0;
+        if (m_Display == EGL_NO_DISPLAY || !eglInitialize(m_Display, &major, &minor))
+        {
+            m_Display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+            if (m_Display == EGL_NO_DISPLAY || !eglInitialize(m_Display, &major, &minor))
+            {
+                std::cout << "HEADLESS:: no EGL display" << std::endl;
+                m_Display = EGL_NO_DISPLAY;
+                return false;
+            }
+        }
+
+        // the surfaceless platform only has pbuffer configs; no surface is created from it
+        const EGLint configAttributes[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(m_Display, configAttributes, &config, 1, &configCount) ||
+            configCount == 0 || !eglBindAPI(EGL_OPENGL_API))
+        {
+            std::cout << "HEADLESS:: no EGL config for desktop OpenGL" << std::endl;
+            eglTerminate(m_Display);
+            m_Display = EGL_NO_DISPLAY;
+            return false;
+        }
+
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+        m_Context = eglCreateContext(m_Display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (m_Context == EGL_NO_CONTEXT)
+        {
+            std::cout << "HEADLESS:: failed to create an OpenGL 3.3 core context (EGL " << major
+                      << "." << minor << ")" << std::endl;
+            eglTerminate(m_Display);
+            m_Display = EGL_NO_DISPLAY;
+            return false;
+        }
+        // EGL_KHR_surfaceless_context: current without a draw or read surface
+        if (!eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_Context))
+        {
+            std::cout << "HEADLESS:: failed to make the context current" << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+#else
+
+class HeadlessContext
+{
+  public:
+    bool create(unsigned int width, unsigned int height)
+    {
+        std::cout << "HEADLESS:: built without EGL, no headless context" << std::endl;
+        return false;
+    }
+
+    void destroy() {}
+
+    static GLADloadproc GetProcAddress() { return nullptr; }
+};
+
+#endif
+
+}; // namespace rg
+#endif // PROJECT_BASE_HEADLESSCONTEXT_H
@@ -0,0 +1,328 @@
+#ifndef PROJECT_BASE_INPUTTRACE_H
+#define PROJECT_BASE_INPUTTRACE_H
+
+#include <rg/MappedFile.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg
+{
+
+// Binary log of everything that drives a run of the program, so a session can be played back
+// frame for frame: the time of each frame, the window's key, cursor and scroll callbacks, and the
+// edits made to the program state outside of them (the ImGui controls), as runs of changed bytes.
+// The state is treated as plain bytes, so it has to be trivially copyable; a trace only replays
+// with a build whose state has the same size.
+//
+// The log is a header with the initial state, followed by records, each a one byte tag:
+//   Frame  float time        starts a frame
+//   Key    int32 key, int32 scancode, uint8 action, uint8 mods
+//   Cursor double x, double y
+//   Scroll double x, double y
+//   State  uint16 offset, uint16 length, length bytes
+//   End
+enum class TraceRecord : uint8_t
+{
+    Frame = 1,
+    Key,
+    Cursor,
+    Scroll,
+    State,
+    End
+};
+
+struct InputEvent
+{
+    TraceRecord type;
+    int key = 0;
+    int scancode = 0;
+    int action = 0;
+    int mods = 0;
+    double x = 0.0;
+    double y = 0.0;
+};
+
+// the start of a trace, followed by stateSize bytes of the initial state
+struct TraceHeader
+{
+    static const uint32_t VERSION = 1;
+
+    char magic[4];
+    uint32_t version;
+    uint32_t stateSize;
+    uint32_t reserved = 0;
+
+    static const char* Magic() { return "RGIT"; }
+};
+
+class InputRecorder
+{
+  public:
+    InputRecorder() = default;
+    InputRecorder(const InputRecorder&) = delete;
+    InputRecorder& operator=(const InputRecorder&) = delete;
+    ~InputRecorder() { close(); }
+
+    bool open(const std::string& path, const void* state, uint32_t stateSize)
+    {
+        m_Out.open(path, std::ios::binary | std::ios::trunc);
+        if (!m_Out)
+        {
+            std::cout << "TRACE::FAILED_TO_WRITE " << path << std::endl;
+            return false;
+        }
+        TraceHeader header;
+        std::memcpy(header.magic, TraceHeader::Magic(), sizeof(header.magic));
+        header.version = TraceHeader::VERSION;
+        header.stateSize = stateSize;
+        write(header);
+        m_Out.write(static_cast<const char*>(state), stateSize);
+        m_StateSize = stateSize;
+        m_Frames = 0;
+        return true;
+    }
+
+    bool recording() const { return m_Out.is_open(); }
+
+    void beginFrame(float time)
+    {
+        if (!recording())
+            return;
+        write(TraceRecord::Frame);
+        write(time);
+        ++m_Frames;
+    }
+
+    void key(int key, int scancode, int action, int mods)
+    {
+        if (!recording())
+            return;
+        write(TraceRecord::Key);
+        write((int32_t)key);
+        write((int32_t)scancode);
+        write((uint8_t)action);
+        write((uint8_t)mods);
+    }
+
+    void cursor(double x, double y) { point(TraceRecord::Cursor, x, y); }
+    void scroll(double x, double y) { point(TraceRecord::Scroll, x, y); }
+
+    // records where after differs from before, both stateSize bytes of the state
+    void stateEdits(const void* before, const void* after)
+    {
+        if (!recording())
+            return;
+        const unsigned char* a = static_cast<const unsigned char*>(before);
+        const unsigned char* b = static_cast<const unsigned char*>(after);
+        uint32_t i = 0;
+        while (i < m_StateSize)
+        {
+            if (a[i] == b[i])
+            {
+                ++i;
+                continue;
+            }
+            // runs closer than a record header are merged
+            uint32_t start = i, end = i + 1, same = 0;
+            for (uint32_t j = end; j < m_StateSize && same < 5 && j - start < 0xffff; ++j)
+            {
+                if (a[j] == b[j])
+                    ++same;
+                else
+                {
+                    end = j + 1;
+                    same = 0;
+                }
+            }
+            write(TraceRecord::State);
+            write((uint16_t)start);
+            write((uint16_t)(end - start));
+            m_Out.write(reinterpret_cast<const char*>(b + start), end - start);
+            i = end;
+        }
+    }
+
+    void close()
+    {
+        if (!recording())
+            return;
+        write(TraceRecord::End);
+        std::cout << "TRACE:: recorded " << m_Frames << " frames, " << m_Out.tellp() / 1024
+                  << " KB" << std::endl;
+        m_Out.close();
+    }
+
+  private:
+    std::ofstream m_Out;
+    uint32_t m_StateSize = 0;
+    unsigned int m_Frames = 0;
+
+    template <typename T> void write(const T& value)
+    {
+        m_Out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void point(TraceRecord type, double x, double y)
+    {
+        if (!recording())
+            return;
+        write(type);
+        write(x);
+        write(y);
+    }
+};
+
+// Reads a trace back one frame at a time. The player also answers key polls from the key events
+// it has dispatched, which is what the window system does when it is asked for a key's state.
+class InputPlayer
+{
+  public:
+    bool open(const std::string& path, uint32_t stateSize)
+    {
+        if (!m_File.open(path))
+        {
+            std::cout << "TRACE::FAILED_TO_READ " << path << std::endl;
+            return false;
+        }
+        m_Pos = m_File.data();
+        m_End = m_File.data() + m_File.size();
+        TraceHeader header;
+        if (!read(header) ||
+            std::memcmp(header.magic, TraceHeader::Magic(), sizeof(header.magic)) != 0 ||
+            header.version != TraceHeader::VERSION || header.stateSize != stateSize ||
+            (size_t)(m_End - m_Pos) < stateSize)
+        {
+            std::cout << "TRACE::INCOMPATIBLE " << path << std::endl;
+            m_File.close();
+            return false;
+        }
+        m_InitialState = m_Pos;
+        m_Pos += stateSize;
+        m_StateSize = stateSize;
+        std::memset(m_Keys, 0, sizeof(m_Keys));
+        return true;
+    }
+
+    bool playing() const { return m_File.isOpen(); }
+
+    // the state the recording started from
+    void initialState(void* state) const { std::memcpy(state, m_InitialState, m_StateSize); }
+
+    // reads the next frame's records; false once the trace is over or turns out truncated
+    bool nextFrame(float& time)
+    {
+        m_Events.clear();
+        m_Edits.clear();
+        TraceRecord type;
+        if (!playing() || !read(type) || type != TraceRecord::Frame || !read(time))
+            return false;
+        for (;;)
+        {
+            const unsigned char* recordStart = m_Pos;
+            if (!read(type))
+                return true;
+            if (type == TraceRecord::Frame || type == TraceRecord::End)
+            {
+                m_Pos = recordStart;
+                return true;
+            }
+            if (type == TraceRecord::State)
+            {
+                Edit edit;
+                if (!read(edit.offset) || !read(edit.length) ||
+                    (uint32_t)edit.offset + edit.length > m_StateSize ||
+                    (size_t)(m_End - m_Pos) < edit.length)
+                    return false;
+                edit.bytes = m_Pos;
+                m_Pos += edit.length;
+                m_Edits.push_back(edit);
+                continue;
+            }
+            InputEvent event;
+            event.type = type;
+            if (type == TraceRecord::Key)
+            {
+                int32_t key, scancode;
+                uint8_t action, mods;
+                if (!read(key) || !read(scancode) || !read(action) || !read(mods))
+                    return false;
+                event.key = key;
+                event.scancode = scancode;
+                event.action = action;
+                event.mods = mods;
+            }
+            else if (type != TraceRecord::Cursor && type != TraceRecord::Scroll)
+                return false;
+            else if (!read(event.x) || !read(event.y))
+                return false;
+            m_Events.push_back(event);
+        }
+    }
+
+    // overwrites the state with the frame's recorded edits
+    void applyStateEdits(void* state) const
+    {
+        for (const Edit& edit : m_Edits)
+            std::memcpy(static_cast<unsigned char*>(state) + edit.offset, edit.bytes, edit.length);
+    }
+
+    // calls onKey(key, scancode, action, mods), onCursor(x, y) and onScroll(x, y) for the frame's
+    // events in recorded order; key polls see a key's new state already in its callback
+    template <typename KeyF, typename CursorF, typename ScrollF>
+    void dispatch(KeyF onKey, CursorF onCursor, ScrollF onScroll)
+    {
+        for (const InputEvent& event : m_Events)
+        {
+            if (event.type == TraceRecord::Key)
+            {
+                if (event.key >= 0 && event.key < MAX_KEYS)
+                    m_Keys[event.key] = event.action != RELEASE;
+                onKey(event.key, event.scancode, event.action, event.mods);
+            }
+            else if (event.type == TraceRecord::Cursor)
+                onCursor(event.x, event.y);
+            else
+                onScroll(event.x, event.y);
+        }
+    }
+
+    bool keyPressed(int key) const { return key >= 0 && key < MAX_KEYS && m_Keys[key]; }
+
+  private:
+    // GLFW_RELEASE; key codes are below GLFW_KEY_LAST + 1
+    static const int RELEASE = 0;
+    static const int MAX_KEYS = 512;
+
+    struct Edit
+    {
+        uint16_t offset = 0;
+        uint16_t length = 0;
+        const unsigned char* bytes = nullptr;
+    };
+
+    MappedFile m_File;
+    const unsigned char* m_Pos = nullptr;
+    const unsigned char* m_End = nullptr;
+    const unsigned char* m_InitialState = nullptr;
+    uint32_t m_StateSize = 0;
+    std::vector<InputEvent> m_Events;
+    std::vector<Edit> m_Edits;
+    bool m_Keys[MAX_KEYS] = {};
+
+    template <typename T> bool read(T& out)
+    {
+        if ((size_t)(m_End - m_Pos) < sizeof(T))
+            return false;
+        std::memcpy(&out, m_Pos, sizeof(T));
+        m_Pos += sizeof(T);
+        return true;
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_INPUTTRACE_H
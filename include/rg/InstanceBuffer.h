@@ -0,0 +1,80 @@
+#ifndef PROJECT_BASE_INSTANCEBUFFER_H
+#define PROJECT_BASE_INSTANCEBUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+
+namespace rg
+{
+
+// Per-instance model matrices for instanced draws. Vertex shaders read them as a mat4 attribute
+// at MATRIX_LOCATION (four vec4 locations, advancing once per instance).
+//
+// The buffer keeps its name for its whole life; upload() orphans the storage, so vertex arrays
+// set up with setupAttributes() stay valid and a draw still reading the previous contents
+// doesn't stall the upload.
+class InstanceBuffer
+{
+  public:
+    static const GLuint MATRIX_LOCATION = 5;
+
+    InstanceBuffer() = default;
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    void upload(const glm::mat4* transforms, size_t count)
+    {
+        create();
+        size_t bytes = count * sizeof(glm::mat4);
+        m_CapacityBytes = std::max(bytes, m_CapacityBytes);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, m_CapacityBytes, nullptr, GL_STREAM_DRAW);
+        if (bytes)
+            glBufferSubData(GL_COPY_WRITE_BUFFER, 0, bytes, transforms);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        m_Count = count;
+    }
+
+    // points the matrix attribute of the bound vertex array at this buffer
+    void setupAttributes()
+    {
+        create();
+        glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+        for (GLuint column = 0; column < 4; ++column)
+        {
+            glEnableVertexAttribArray(MATRIX_LOCATION + column);
+            glVertexAttribPointer(
+                MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                (void*)(column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(MATRIX_LOCATION + column, 1);
+        }
+    }
+
+    void destroy()
+    {
+        if (m_Buffer)
+            glDeleteBuffers(1, &m_Buffer);
+        m_Buffer = 0;
+        m_CapacityBytes = m_Count = 0;
+    }
+
+    // instances in the last upload
+    size_t count() const { return m_Count; }
+
+  private:
+    unsigned int m_Buffer = 0;
+    size_t m_CapacityBytes = 0;
+    size_t m_Count = 0;
+
+    void create()
+    {
+        if (!m_Buffer)
+            glGenBuffers(1, &m_Buffer);
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_INSTANCEBUFFER_H
@@ -0,0 +1,85 @@
+#ifndef PROJECT_BASE_LOD_H
+#define PROJECT_BASE_LOD_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <vector>
+
+namespace rg
+{
+
+const unsigned int MAX_LODS = 5;
+
+// one level of detail of a mesh: a range of its index buffer. All levels share the vertices.
+struct MeshLod
+{
+    unsigned int indexOffset = 0;
+    unsigned int indexCount = 0;
+    // geometric deviation from level 0, in object space units
+    float error = 0.0f;
+};
+
+// what was drawn at which level, reset every frame
+struct LodStats
+{
+    unsigned int meshes[MAX_LODS] = {};
+    unsigned int triangles[MAX_LODS] = {};
+
+    void reset() { *this = LodStats(); }
+};
+
+// Picks levels of detail from the projected size of a mesh's bounding sphere: the coarsest level
+// whose error, scaled to the projected radius, stays below thresholdPixels * 2^bias.
+struct LodSelector
+{
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    // viewport height / (2 * tan(fovY / 2)): pixels per unit at distance 1
+    float projectionScale = 1.0f;
+    float thresholdPixels = 1.0f;
+    // log2 of the allowed error, positive values switch to coarser levels earlier
+    float bias = 0.0f;
+    LodStats* stats = nullptr;
+
+    LodSelector() = default;
+    LodSelector(
+        const glm::vec3& cameraPosition, float fovYRadians, float viewportHeight, float bias,
+        LodStats* stats = nullptr)
+        : cameraPosition(cameraPosition),
+          projectionScale(viewportHeight / (2.0f * std::tan(fovYRadians * 0.5f))), bias(bias),
+          stats(stats)
+    {
+    }
+
+    // center and radius in world space, scale maps object space lod errors to world space
+    unsigned int select(
+        const std::vector<MeshLod>& lods, const glm::vec3& center, float radius, float scale) const
+    {
+        float distance = glm::length(center - cameraPosition) - radius;
+        if (lods.size() < 2 || radius <= 0.0f || distance <= 0.0f)
+            return 0;
+
+        float projectedRadius = radius * projectionScale / distance;
+        float allowed = thresholdPixels * std::exp2(bias);
+        unsigned int level = 0;
+        for (unsigned int i = 1; i < lods.size(); ++i)
+        {
+            // fraction of the sphere the error covers, times its size on screen
+            if (lods[i].error * scale / radius * projectedRadius > allowed)
+                break;
+            level = i;
+        }
+        return level;
+    }
+
+    void record(const MeshLod& lod, unsigned int level) const
+    {
+        if (!stats)
+            return;
+        ++stats->meshes[level];
+        stats->triangles[level] += lod.indexCount / 3;
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_LOD_H
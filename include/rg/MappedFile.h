@@ -0,0 +1,76 @@
+#ifndef PROJECT_BASE_MAPPEDFILE_H
+#define PROJECT_BASE_MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rg
+{
+
+// Read-only memory mapping of a whole file. Unmapped when the object goes out of scope.
+class MappedFile
+{
+  public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path) { open(path); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                m_Data = static_cast<const unsigned char*>(mapping);
+                m_Size = st.st_size;
+            }
+        }
+        ::close(fd);
+        return m_Data != nullptr;
+    }
+
+    void close()
+    {
+        if (m_Data)
+            munmap(const_cast<unsigned char*>(m_Data), m_Size);
+        m_Data = nullptr;
+        m_Size = 0;
+    }
+
+    bool isOpen() const { return m_Data != nullptr; }
+    const unsigned char* data() const { return m_Data; }
+    size_t size() const { return m_Size; }
+
+  private:
+    const unsigned char* m_Data = nullptr;
+    size_t m_Size = 0;
+};
+
+// size and modification time (in nanoseconds) of a file, used for cheap staleness checks.
+inline bool statFile(const std::string& path, uint64_t& size, int64_t& mtimeNs)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+    size = st.st_size;
+    mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+}; // namespace rg
+#endif // PROJECT_BASE_MAPPEDFILE_H
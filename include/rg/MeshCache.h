@@ -0,0 +1,240 @@
+#ifndef PROJECT_BASE_MESHCACHE_H
+#define PROJECT_BASE_MESHCACHE_H
+
+#include <learnopengl/mesh.h>
+#include <rg/Hash.h>
+#include <rg/MappedFile.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg
+{
+
+// On-disk cache of post-processed model geometry, stored next to the source file as
+// <model>.meshcache. It holds the final Vertex/index arrays, LOD ranges, bounds and texture
+// bindings of every mesh after welding, reordering (MeshOptimizer.h) and simplification
+// (MeshSimplifier.h), so a warm start maps the file and skips Assimp and the optimizers
+// entirely. The cache is rebuilt whenever the format version, the Vertex layout, the Assimp
+// import flags or the source file change.
+class MeshCache
+{
+  public:
+    static const uint32_t VERSION = 6;
+
+    static std::string CachePathFor(const std::string& sourcePath)
+    {
+        return sourcePath + ".meshcache";
+    }
+
+    // fills meshes from the cache of sourcePath; returns false on a miss or a stale cache
+    static bool Load(
+        const std::string& sourcePath, uint32_t importFlags, std::vector<MeshData>& meshes)
+    {
+        MappedFile file;
+        if (!file.open(CachePathFor(sourcePath)))
+            return false;
+
+        Reader reader{file.data(), file.data() + file.size()};
+        Header header;
+        if (!reader.read(header) || std::memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != VERSION || header.vertexSize != sizeof(Vertex) ||
+            header.importFlags != importFlags)
+            return false;
+
+        if (!isSourceUnchanged(sourcePath, header))
+            return false;
+
+        // counts are checked against the bytes left before anything is allocated for them, so a
+        // corrupt cache is rejected instead of asking for gigabytes
+        if (!reader.fits(header.meshCount, 4 * sizeof(uint32_t)))
+            return false;
+        std::vector<MeshData> result(header.meshCount);
+        for (MeshData& mesh : result)
+        {
+            uint32_t vertexCount, indexCount, textureCount, lodCount;
+            if (!reader.read(vertexCount) || !reader.read(indexCount) ||
+                !reader.read(textureCount) || !reader.read(lodCount))
+                return false;
+            // every texture has two string lengths
+            if (!reader.fits(textureCount, 2 * sizeof(uint32_t)))
+                return false;
+            mesh.textures.resize(textureCount);
+            for (TextureRef& texture : mesh.textures)
+            {
+                if (!reader.readString(texture.type) || !reader.readString(texture.path))
+                    return false;
+            }
+            if (!reader.fits(lodCount, sizeof(MeshLod)))
+                return false;
+            mesh.lods.resize(lodCount);
+            if (!reader.readArray(mesh.lods.data(), lodCount) || !reader.read(mesh.bounds))
+                return false;
+            for (const MeshLod& lod : mesh.lods)
+            {
+                if ((uint64_t)lod.indexOffset + lod.indexCount > indexCount)
+                    return false;
+            }
+            uint64_t geometryBytes = (uint64_t)vertexCount * sizeof(Vertex) +
+                                     (uint64_t)indexCount * sizeof(unsigned int);
+            if (geometryBytes > (uint64_t)(reader.end - reader.pos))
+                return false;
+            mesh.vertices.resize(vertexCount);
+            mesh.indices.resize(indexCount);
+            if (!reader.readArray(mesh.vertices.data(), vertexCount) ||
+                !reader.readArray(mesh.indices.data(), indexCount))
+                return false;
+            for (unsigned int index : mesh.indices)
+            {
+                if (index >= vertexCount)
+                    return false;
+            }
+        }
+        meshes.swap(result);
+        return true;
+    }
+
+    static void Store(
+        const std::string& sourcePath, uint32_t importFlags, const std::vector<MeshData>& meshes)
+    {
+        Header header;
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.importFlags = importFlags;
+        header.vertexSize = sizeof(Vertex);
+        header.meshCount = meshes.size();
+        if (!statFile(sourcePath, header.sourceSize, header.sourceMtime) ||
+            !hashFile(sourcePath, header.sourceHash))
+            return;
+
+        // write to a temporary file and rename it, so a crash never leaves a torn cache behind
+        std::string cachePath = CachePathFor(sourcePath);
+        std::string tmpPath = cachePath + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+            {
+                std::cout << "MESH_CACHE::FAILED_TO_WRITE " << cachePath << std::endl;
+                return;
+            }
+            write(out, header);
+            for (const MeshData& mesh : meshes)
+            {
+                write(out, (uint32_t)mesh.vertices.size());
+                write(out, (uint32_t)mesh.indices.size());
+                write(out, (uint32_t)mesh.textures.size());
+                write(out, (uint32_t)mesh.lods.size());
+                for (const TextureRef& texture : mesh.textures)
+                {
+                    writeString(out, texture.type);
+                    writeString(out, texture.path);
+                }
+                out.write(
+                    reinterpret_cast<const char*>(mesh.lods.data()),
+                    mesh.lods.size() * sizeof(MeshLod));
+                write(out, mesh.bounds);
+                out.write(
+                    reinterpret_cast<const char*>(mesh.vertices.data()),
+                    mesh.vertices.size() * sizeof(Vertex));
+                out.write(
+                    reinterpret_cast<const char*>(mesh.indices.data()),
+                    mesh.indices.size() * sizeof(unsigned int));
+            }
+            if (!out)
+            {
+                std::remove(tmpPath.c_str());
+                return;
+            }
+        }
+        std::rename(tmpPath.c_str(), cachePath.c_str());
+    }
+
+  private:
+    static constexpr const char* MAGIC = "RGMC";
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t importFlags;
+        uint32_t vertexSize;
+        uint64_t sourceSize;
+        int64_t sourceMtime;
+        uint64_t sourceHash;
+        uint32_t meshCount;
+        uint32_t reserved = 0;
+    };
+
+    // bounds-checked cursor over the mapped cache file
+    struct Reader
+    {
+        const unsigned char* pos;
+        const unsigned char* end;
+
+        template <typename T> bool readArray(T* out, size_t count)
+        {
+            size_t bytes = count * sizeof(T);
+            if ((size_t)(end - pos) < bytes)
+                return false;
+            std::memcpy(out, pos, bytes);
+            pos += bytes;
+            return true;
+        }
+        template <typename T> bool read(T& out) { return readArray(&out, 1); }
+        // whether count elements of at least elementSize bytes each can still be left
+        bool fits(uint64_t count, size_t elementSize) const
+        {
+            return count <= (uint64_t)(end - pos) / elementSize;
+        }
+        bool readString(std::string& out)
+        {
+            uint32_t length;
+            if (!read(length) || (size_t)(end - pos) < length)
+                return false;
+            out.assign(reinterpret_cast<const char*>(pos), length);
+            pos += length;
+            return true;
+        }
+    };
+
+    template <typename T> static void write(std::ofstream& out, const T& value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    static void writeString(std::ofstream& out, const std::string& str)
+    {
+        write(out, (uint32_t)str.size());
+        out.write(str.data(), str.size());
+    }
+
+    static bool hashFile(const std::string& path, uint64_t& hash)
+    {
+        MappedFile source(path);
+        if (!source.isOpen())
+            return false;
+        hash = fnv1a64(source.data(), source.size());
+        return true;
+    }
+
+    // size+mtime is the fast path; when only the timestamp moved (fresh checkout, touch) the
+    // content hash decides
+    static bool isSourceUnchanged(const std::string& sourcePath, const Header& header)
+    {
+        uint64_t size;
+        int64_t mtime;
+        if (!statFile(sourcePath, size, mtime) || size != header.sourceSize)
+            return false;
+        if (mtime == header.sourceMtime)
+            return true;
+        uint64_t hash;
+        return hashFile(sourcePath, hash) && hash == header.sourceHash;
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_MESHCACHE_H
@@ -0,0 +1,423 @@
+#ifndef PROJECT_BASE_MESHOPTIMIZER_H
+#define PROJECT_BASE_MESHOPTIMIZER_H
+
+#include <glm/glm.hpp>
+#include <rg/Hash.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace rg
+{
+
+// Post-import optimization of indexed triangle lists:
+//   weldVertices        - merges bitwise identical vertices (OBJ import gives one per corner)
+//   optimizeVertexCache - reorders triangles for the post-transform cache (Forsyth)
+//   optimizeOverdraw    - reorders clusters of that order so outward facing ones draw first
+//   optimizeVertexFetch - renumbers vertices in first use order for linear vertex fetch
+//   splitMesh           - cuts meshes that are too large for 16-bit indices
+// optimizeMesh runs all of them. Vertex types need a glm::vec3 Position member (Vertex).
+
+// FIFO post-transform cache simulation
+struct VertexCacheStats
+{
+    float acmr = 0.0f; // average cache miss ratio: transformed vertices per triangle (0.5 .. 3)
+    float atvr = 0.0f; // average transformed vertex ratio: transformed / unique vertices (>= 1)
+};
+
+inline VertexCacheStats analyzeVertexCache(
+    const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16)
+{
+    VertexCacheStats stats;
+    if (indices.empty() || vertexCount == 0)
+        return stats;
+
+    // a vertex is in the cache while fewer than cacheSize misses happened since it was loaded
+    std::vector<size_t> loadedAt(vertexCount, 0);
+    size_t misses = 0;
+    for (unsigned int index : indices)
+    {
+        if (loadedAt[index] == 0 || misses - loadedAt[index] >= cacheSize)
+            loadedAt[index] = ++misses;
+    }
+    size_t usedVertices = 0;
+    for (size_t at : loadedAt)
+        usedVertices += at != 0;
+    stats.acmr = (float)misses / (indices.size() / 3);
+    stats.atvr = (float)misses / usedVertices;
+    return stats;
+}
+
+// merges vertices with identical bytes and rewrites the indices; returns the new vertex count
+template <typename VertexT>
+size_t weldVertices(std::vector<VertexT>& vertices, std::vector<unsigned int>& indices)
+{
+    struct BytesHash
+    {
+        const VertexT* vertices;
+        size_t operator()(unsigned int i) const { return fnv1a64(&vertices[i], sizeof(VertexT)); }
+    };
+    struct BytesEqual
+    {
+        const VertexT* vertices;
+        bool operator()(unsigned int a, unsigned int b) const
+        {
+            return std::memcmp(&vertices[a], &vertices[b], sizeof(VertexT)) == 0;
+        }
+    };
+
+    std::unordered_map<unsigned int, unsigned int, BytesHash, BytesEqual> unique(
+        vertices.size(), BytesHash{vertices.data()}, BytesEqual{vertices.data()});
+    std::vector<unsigned int> remap(vertices.size());
+    size_t weldedCount = 0;
+    for (unsigned int i = 0; i < vertices.size(); ++i)
+    {
+        auto inserted = unique.emplace(i, (unsigned int)weldedCount);
+        if (inserted.second)
+            ++weldedCount;
+        remap[i] = inserted.first->second;
+    }
+
+    // welded vertices keep the order of their first occurrence
+    std::vector<VertexT> welded(weldedCount);
+    for (unsigned int i = 0; i < vertices.size(); ++i)
+        welded[remap[i]] = vertices[i];
+    for (unsigned int& index : indices)
+        index = remap[index];
+    vertices.swap(welded);
+    return weldedCount;
+}
+
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": greedily emits the triangle with the
+// best score, where vertices score higher when they are recently used or have few remaining
+// triangles. Works for any cache size and replacement policy reasonably well.
+inline void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    const int CACHE_SIZE = 32;
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    auto vertexScore = [](int cachePosition, unsigned int remaining)
+    {
+        if (remaining == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // the vertices of the last triangle get a fixed score, so the order inside it
+            // doesn't matter
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = std::pow(1.0f - (cachePosition - 3) / (float)(CACHE_SIZE - 3), 1.5f);
+        }
+        // boost vertices with few triangles left, to finish them off and avoid islands
+        return score + 2.0f / std::sqrt((float)remaining);
+    };
+
+    // per vertex list of the triangles that use it
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int index : indices)
+        ++remaining[index];
+    std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+        firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+        adjacency[filled[indices[i]]++] = (unsigned int)(i / 3);
+
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        score[v] = vertexScore(-1, remaining[v]);
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+        triangleScore[t] =
+            score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+    std::vector<bool> emitted(triangleCount, false);
+
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(CACHE_SIZE + 3);
+    nextCache.reserve(CACHE_SIZE + 3);
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    size_t scanCursor = 0;
+
+    long best = 0;
+    while (best >= 0)
+    {
+        const unsigned int* triangle = &indices[best * 3];
+        emitted[best] = true;
+        result.insert(result.end(), triangle, triangle + 3);
+
+        // the emitted vertices move to the front of the LRU cache
+        nextCache.clear();
+        for (int k = 0; k < 3; ++k)
+            if (std::find(nextCache.begin(), nextCache.end(), triangle[k]) == nextCache.end())
+                nextCache.push_back(triangle[k]);
+        for (unsigned int v : cache)
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                nextCache.push_back(v);
+        for (int k = 0; k < 3; ++k)
+        {
+            // drop the emitted triangle from its vertices' lists
+            unsigned int v = triangle[k];
+            unsigned int* begin = &adjacency[firstTriangle[v]];
+            unsigned int* end = begin + remaining[v];
+            *std::find(begin, end, (unsigned int)best) = *(end - 1);
+            --remaining[v];
+        }
+
+        // rescore everything that was or is in the cache, then pick the best triangle among the
+        // ones touching it
+        for (size_t i = 0; i < nextCache.size(); ++i)
+        {
+            unsigned int v = nextCache[i];
+            int cachePosition = i < (size_t)CACHE_SIZE ? (int)i : -1;
+            float delta = vertexScore(cachePosition, remaining[v]) - score[v];
+            score[v] += delta;
+            for (unsigned int a = 0; a < remaining[v]; ++a)
+                triangleScore[adjacency[firstTriangle[v] + a]] += delta;
+        }
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : nextCache)
+        {
+            for (unsigned int a = 0; a < remaining[v]; ++a)
+            {
+                unsigned int t = adjacency[firstTriangle[v] + a];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+        if (nextCache.size() > (size_t)CACHE_SIZE)
+            nextCache.resize(CACHE_SIZE);
+        cache.swap(nextCache);
+
+        // nothing adjacent left: continue with the next triangle in input order
+        if (best < 0)
+        {
+            while (scanCursor < triangleCount && emitted[scanCursor])
+                ++scanCursor;
+            if (scanCursor < triangleCount)
+                best = (long)scanCursor;
+        }
+    }
+    indices.swap(result);
+}
+
+// Splits the (cache optimized) triangle order into clusters wherever the cache went cold and
+// draws the clusters facing away from the mesh center first, so convex-ish parts occlude the
+// rest. Keeps the cache order if that costs more than `threshold` times the original ACMR, both
+// measured with a FIFO cache of cacheSize entries.
+template <typename VertexT>
+void optimizeOverdraw(
+    std::vector<unsigned int>& indices, const std::vector<VertexT>& vertices,
+    float threshold = 1.05f, unsigned int cacheSize = 16)
+{
+    const size_t triangleCount = indices.size() / 3;
+    const size_t MIN_CLUSTER_TRIANGLES = 32;
+    if (triangleCount < 2 * MIN_CLUSTER_TRIANGLES)
+        return;
+
+    // cluster boundaries: triangles that miss the cache on all three vertices
+    std::vector<size_t> clusterStart;
+    std::vector<size_t> loadedAt(vertices.size(), 0);
+    size_t misses = 0;
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        int triangleMisses = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned int v = indices[t * 3 + k];
+            if (loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize)
+            {
+                loadedAt[v] = ++misses;
+                ++triangleMisses;
+            }
+        }
+        if (clusterStart.empty() ||
+            (triangleMisses == 3 && t - clusterStart.back() >= MIN_CLUSTER_TRIANGLES))
+            clusterStart.push_back(t);
+    }
+    if (clusterStart.size() < 2)
+        return;
+    clusterStart.push_back(triangleCount);
+
+    glm::vec3 meshCenter(0.0f);
+    for (const VertexT& vertex : vertices)
+        meshCenter += vertex.Position;
+    meshCenter /= (float)vertices.size();
+
+    struct Cluster
+    {
+        size_t begin, end;
+        float sortKey;
+    };
+    std::vector<Cluster> clusters;
+    for (size_t c = 0; c + 1 < clusterStart.size(); ++c)
+    {
+        glm::vec3 center(0.0f), normal(0.0f);
+        float totalArea = 0.0f;
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; ++t)
+        {
+            const glm::vec3& a = vertices[indices[t * 3]].Position;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& c2 = vertices[indices[t * 3 + 2]].Position;
+            // area weighted
+            glm::vec3 faceNormal = glm::cross(b - a, c2 - a);
+            float area = glm::length(faceNormal);
+            center += (a + b + c2) * (area / 3.0f);
+            totalArea += area;
+            normal += faceNormal;
+        }
+        float normalLength = glm::length(normal);
+        float key = 0.0f;
+        if (totalArea > 0.0f && normalLength > 0.0f)
+            key = glm::dot(center / totalArea - meshCenter, normal / normalLength);
+        clusters.push_back(Cluster{clusterStart[c], clusterStart[c + 1], key});
+    }
+    std::stable_sort(
+        clusters.begin(), clusters.end(),
+        [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (const Cluster& cluster : clusters)
+        result.insert(
+            result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+
+    if (analyzeVertexCache(result, vertices.size(), cacheSize).acmr <=
+        analyzeVertexCache(indices, vertices.size(), cacheSize).acmr * threshold)
+        indices.swap(result);
+}
+
+// renumbers vertices in the order the indices first reference them and drops unused ones
+template <typename VertexT>
+void optimizeVertexFetch(std::vector<VertexT>& vertices, std::vector<unsigned int>& indices)
+{
+    const unsigned int UNUSED = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), UNUSED);
+    std::vector<VertexT> reordered;
+    reordered.reserve(vertices.size());
+    for (unsigned int& index : indices)
+    {
+        if (remap[index] == UNUSED)
+        {
+            remap[index] = (unsigned int)reordered.size();
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+template <typename VertexT> struct MeshPart
+{
+    std::vector<VertexT> vertices;
+    std::vector<unsigned int> indices;
+};
+
+// Cuts a mesh into parts of at most maxVertices vertices (e.g. to fit 16-bit indices), following
+// the triangle order; after optimizeVertexCache that keeps the parts spatially coherent. Vertices
+// on a cut are duplicated, and each part's vertices are in first use order.
+template <typename VertexT>
+std::vector<MeshPart<VertexT>> splitMesh(
+    const std::vector<VertexT>& vertices, const std::vector<unsigned int>& indices,
+    size_t maxVertices)
+{
+    const unsigned int UNUSED = ~0u;
+    std::vector<MeshPart<VertexT>> parts;
+    std::vector<unsigned int> remap(vertices.size(), UNUSED);
+    MeshPart<VertexT> part;
+    std::vector<unsigned int> partVertices; // source indices of part.vertices, to reset remap
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        size_t added = 0;
+        for (int k = 0; k < 3; ++k)
+            added += remap[indices[i + k]] == UNUSED;
+        if (part.vertices.size() + added > maxVertices)
+        {
+            parts.push_back(std::move(part));
+            part = MeshPart<VertexT>();
+            for (unsigned int v : partVertices)
+                remap[v] = UNUSED;
+            partVertices.clear();
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned int v = indices[i + k];
+            if (remap[v] == UNUSED)
+            {
+                remap[v] = (unsigned int)part.vertices.size();
+                part.vertices.push_back(vertices[v]);
+                partVertices.push_back(v);
+            }
+            part.indices.push_back(remap[v]);
+        }
+    }
+    if (!part.indices.empty())
+        parts.push_back(std::move(part));
+    return parts;
+}
+
+struct MeshOptimizationStats
+{
+    size_t verticesBefore = 0, verticesAfter = 0, triangles = 0;
+    VertexCacheStats before, after;
+
+    // triangle weighted accumulation over several meshes
+    void merge(const MeshOptimizationStats& other)
+    {
+        size_t total = triangles + other.triangles;
+        if (total == 0)
+            return;
+        auto blend = [&](float a, float b)
+        { return (a * triangles + b * other.triangles) / total; };
+        // ATVR is per vertex, weight it by vertices instead
+        auto blendVertices = [](float a, size_t wa, float b, size_t wb)
+        { return wa + wb == 0 ? 0.0f : (a * wa + b * wb) / (wa + wb); };
+        before.acmr = blend(before.acmr, other.before.acmr);
+        after.acmr = blend(after.acmr, other.after.acmr);
+        before.atvr =
+            blendVertices(before.atvr, verticesAfter, other.before.atvr, other.verticesAfter);
+        after.atvr =
+            blendVertices(after.atvr, verticesAfter, other.after.atvr, other.verticesAfter);
+        verticesBefore += other.verticesBefore;
+        verticesAfter += other.verticesAfter;
+        triangles = total;
+    }
+};
+
+// full pass over an imported mesh; the "before" numbers are measured on the welded input, since
+// ACMR and ATVR of an unwelded mesh are always 3 and 1
+template <typename VertexT>
+MeshOptimizationStats optimizeMesh(
+    std::vector<VertexT>& vertices, std::vector<unsigned int>& indices)
+{
+    MeshOptimizationStats stats;
+    stats.verticesBefore = vertices.size();
+    stats.triangles = indices.size() / 3;
+    if (indices.empty())
+        return stats;
+
+    weldVertices(vertices, indices);
+    stats.before = analyzeVertexCache(indices, vertices.size());
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices);
+    optimizeVertexFetch(vertices, indices);
+    stats.after = analyzeVertexCache(indices, vertices.size());
+    stats.verticesAfter = vertices.size();
+    return stats;
+}
+
+}; // namespace rg
+#endif // PROJECT_BASE_MESHOPTIMIZER_H
@@ -0,0 +1,301 @@
+#ifndef PROJECT_BASE_MESHSIMPLIFIER_H
+#define PROJECT_BASE_MESHSIMPLIFIER_H
+
+#include <glm/glm.hpp>
+#include <rg/Lod.h>
+#include <rg/MeshOptimizer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace rg
+{
+
+// Quadric error metric (Garland & Heckbert): sum of squared distances to a set of planes,
+// weighted by triangle area. evaluate() / weight is the mean squared distance.
+struct Quadric
+{
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+    double weight = 0;
+
+    static Quadric fromPlane(const glm::vec3& n, float d, float w)
+    {
+        Quadric q;
+        q.a2 = w * n.x * n.x, q.ab = w * n.x * n.y, q.ac = w * n.x * n.z, q.ad = w * n.x * d;
+        q.b2 = w * n.y * n.y, q.bc = w * n.y * n.z, q.bd = w * n.y * d;
+        q.c2 = w * n.z * n.z, q.cd = w * n.z * d;
+        q.d2 = w * d * d;
+        q.weight = w;
+        return q;
+    }
+
+    Quadric& operator+=(const Quadric& o)
+    {
+        a2 += o.a2, ab += o.ab, ac += o.ac, ad += o.ad, b2 += o.b2;
+        bc += o.bc, bd += o.bd, c2 += o.c2, cd += o.cd, d2 += o.d2;
+        weight += o.weight;
+        return *this;
+    }
+
+    double evaluate(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double r = a2 * x * x + b2 * y * y + c2 * z * z + d2 +
+                   2 * (ab * x * y + ac * x * z + ad * x + bc * y * z + bd * y + cd * z);
+        return std::max(r, 0.0);
+    }
+};
+
+// Simplifies an indexed triangle list by edge collapses in order of quadric error, until it is
+// down to targetIndexCount indices or the next collapse would exceed targetError (relative to
+// the mesh extent). Vertices are only ever moved onto existing ones, so the result indexes the
+// same vertex array. Vertices on open borders and attribute seams (several vertices at the same
+// position) stay in place, which keeps UVs and silhouettes intact. The reached error, relative
+// to the mesh extent, is returned in resultError.
+template <typename VertexT>
+std::vector<unsigned int> simplify(
+    const std::vector<VertexT>& vertices, const std::vector<unsigned int>& indices,
+    size_t targetIndexCount, float targetError, float* resultError = nullptr)
+{
+    const size_t vertexCount = vertices.size();
+    std::vector<unsigned int> result = indices;
+    if (resultError)
+        *resultError = 0.0f;
+    if (indices.size() <= targetIndexCount || vertexCount == 0)
+        return result;
+
+    // work in a unit cube so errors and thresholds don't depend on the model's scale
+    glm::vec3 lo = vertices[0].Position, hi = vertices[0].Position;
+    for (const VertexT& vertex : vertices)
+    {
+        lo = glm::min(lo, vertex.Position);
+        hi = glm::max(hi, vertex.Position);
+    }
+    glm::vec3 size = hi - lo;
+    float extent = std::max(size.x, std::max(size.y, size.z));
+    if (extent <= 0.0f)
+        return result;
+    std::vector<glm::vec3> positions(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        positions[v] = (vertices[v].Position - lo) / extent;
+
+    // lock attribute seams ...
+    std::vector<bool> locked(vertexCount, false);
+    {
+        struct PositionHash
+        {
+            size_t operator()(const glm::vec3& p) const { return fnv1a64(&p, sizeof(p)); }
+        };
+        struct PositionEqual
+        {
+            bool operator()(const glm::vec3& a, const glm::vec3& b) const
+            {
+                return std::memcmp(&a, &b, sizeof(a)) == 0;
+            }
+        };
+        std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> firstAt;
+        firstAt.reserve(vertexCount);
+        for (unsigned int v = 0; v < vertexCount; ++v)
+        {
+            auto inserted = firstAt.emplace(vertices[v].Position, v);
+            if (!inserted.second)
+                locked[v] = locked[inserted.first->second] = true;
+        }
+    }
+    // ... and open borders: edges used by a single triangle
+    {
+        std::unordered_map<uint64_t, int> edgeUse;
+        edgeUse.reserve(indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int a = indices[i + k], b = indices[i + (k + 1) % 3];
+                ++edgeUse[(uint64_t)std::min(a, b) << 32 | std::max(a, b)];
+            }
+        for (const auto& edge : edgeUse)
+            if (edge.second == 1)
+                locked[edge.first >> 32] = locked[edge.first & 0xffffffffu] = true;
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const glm::vec3& p0 = positions[indices[i]];
+        const glm::vec3& p1 = positions[indices[i + 1]];
+        const glm::vec3& p2 = positions[indices[i + 2]];
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float area = glm::length(normal);
+        if (area <= 0.0f)
+            continue;
+        normal /= area;
+        Quadric q = Quadric::fromPlane(normal, -glm::dot(normal, p0), area * 0.5f);
+        for (int k = 0; k < 3; ++k)
+            quadrics[indices[i + k]] += q;
+    }
+    auto collapseError = [&](unsigned int from, unsigned int to)
+    {
+        Quadric q = quadrics[from];
+        q += quadrics[to];
+        return q.weight > 0.0 ? q.evaluate(positions[to]) / q.weight : 0.0;
+    };
+
+    struct Collapse
+    {
+        unsigned int from, to;
+        double error;
+    };
+    const double maxError = (double)targetError * targetError;
+    double reachedError = 0.0;
+    std::vector<Collapse> collapses;
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<unsigned int> firstTriangle(vertexCount + 1), adjacency;
+
+    while (result.size() > targetIndexCount)
+    {
+        // triangles around each vertex, for the flip test
+        std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+        for (unsigned int index : result)
+            ++firstTriangle[index + 1];
+        for (size_t v = 0; v < vertexCount; ++v)
+            firstTriangle[v + 1] += firstTriangle[v];
+        adjacency.resize(result.size());
+        std::vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t i = 0; i < result.size(); ++i)
+            adjacency[filled[result[i]]++] = (unsigned int)(i / 3);
+
+        // cheapest direction of every edge; interior edges show up as a->b in one triangle and
+        // b->a in the other, borders are locked anyway
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int a = result[i + k], b = result[i + (k + 1) % 3];
+                if (a > b)
+                    continue;
+                double ab = locked[a] ? INFINITY : collapseError(a, b);
+                double ba = locked[b] ? INFINITY : collapseError(b, a);
+                if (ab == INFINITY && ba == INFINITY)
+                    continue;
+                collapses.push_back(ab <= ba ? Collapse{a, b, ab} : Collapse{b, a, ba});
+            }
+        std::sort(
+            collapses.begin(), collapses.end(),
+            [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+        // each collapse removes about two triangles; only apply as many as needed
+        size_t goal = (result.size() - targetIndexCount) / 6 + 1;
+        size_t applied = 0;
+        for (size_t v = 0; v < vertexCount; ++v)
+            remap[v] = (unsigned int)v;
+        std::fill(touched.begin(), touched.end(), false);
+        for (const Collapse& collapse : collapses)
+        {
+            if (collapse.error > maxError || applied >= goal)
+                break;
+            unsigned int from = collapse.from, to = collapse.to;
+            if (touched[from] || touched[to])
+                continue;
+
+            // reject collapses that flip a triangle around `from`
+            bool flips = false;
+            for (unsigned int a = firstTriangle[from]; a < firstTriangle[from + 1] && !flips; ++a)
+            {
+                const unsigned int* t = &result[adjacency[a] * 3];
+                if (t[0] == to || t[1] == to || t[2] == to)
+                    continue;
+                glm::vec3 p[3], q[3];
+                for (int k = 0; k < 3; ++k)
+                {
+                    p[k] = positions[t[k]];
+                    q[k] = t[k] == from ? positions[to] : p[k];
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                flips = glm::dot(before, after) <= 0.0f;
+            }
+            if (flips)
+                continue;
+
+            remap[from] = to;
+            quadrics[to] += quadrics[from];
+            reachedError = std::max(reachedError, collapse.error);
+            ++applied;
+            // freeze the neighborhood, later flip tests this pass assume it doesn't move
+            for (unsigned int a = firstTriangle[from]; a < firstTriangle[from + 1]; ++a)
+                for (int k = 0; k < 3; ++k)
+                    touched[result[adjacency[a] * 3 + k]] = true;
+        }
+        if (applied == 0)
+            break;
+
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if (resultError)
+        *resultError = (float)std::sqrt(reachedError);
+    return result;
+}
+
+// Appends coarser levels to `indices` (which holds level 0) until the target error is reached or
+// a level no longer gets meaningfully smaller. Each level halves the triangle count of the one
+// before and is optimized for the vertex cache on its own.
+template <typename VertexT>
+std::vector<MeshLod> buildLodChain(
+    const std::vector<VertexT>& vertices, std::vector<unsigned int>& indices,
+    float maxRelativeError = 0.05f)
+{
+    std::vector<MeshLod> lods(1);
+    lods[0].indexCount = (unsigned int)indices.size();
+
+    glm::vec3 lo(0.0f), hi(0.0f);
+    if (!vertices.empty())
+        lo = hi = vertices[0].Position;
+    for (const VertexT& vertex : vertices)
+    {
+        lo = glm::min(lo, vertex.Position);
+        hi = glm::max(hi, vertex.Position);
+    }
+    glm::vec3 size = hi - lo;
+    float extent = std::max(size.x, std::max(size.y, size.z));
+
+    std::vector<unsigned int> previous = indices;
+    float previousError = 0.0f;
+    while (lods.size() < MAX_LODS && previous.size() >= 3 * 64)
+    {
+        float error = 0.0f;
+        std::vector<unsigned int> level = simplify(
+            vertices, previous, previous.size() / 6 * 3, maxRelativeError - previousError,
+            &error);
+        if (level.empty() || level.size() > previous.size() * 85 / 100)
+            break;
+        optimizeVertexCache(level, vertices.size());
+
+        // errors of successive levels add up at most
+        previousError += error;
+        MeshLod lod;
+        lod.indexOffset = (unsigned int)indices.size();
+        lod.indexCount = (unsigned int)level.size();
+        lod.error = previousError * extent;
+        lods.push_back(lod);
+        indices.insert(indices.end(), level.begin(), level.end());
+        previous.swap(level);
+    }
+    return lods;
+}
+
+}; // namespace rg
+#endif // PROJECT_BASE_MESHSIMPLIFIER_H
@@ -0,0 +1,224 @@
+#ifndef PROJECT_BASE_OCCLUSIONQUERIES_H
+#define PROJECT_BASE_OCCLUSIONQUERIES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+#include <rg/GLState.h>
+
+#include <vector>
+
+namespace rg
+{
+
+// GPU occlusion culling with GL_ANY_SAMPLES_PASSED queries on bounding boxes.
+//
+// Each frame, after the objects that were visible last frame have been drawn, the box of every
+// object is drawn with depth test on and color and depth writes off, inside a query. Results are
+// read back a frame later and only if they are available, so the CPU never waits for the GPU.
+// Objects whose last result was hidden are not drawn normally but under conditional rendering on
+// this frame's query: the GPU drops their draws itself when the box turned out hidden, and draws
+// them if the result isn't in yet.
+//
+// Objects are slots 0 .. count-1, the same every frame; slots without a result count as visible.
+class OcclusionQueries
+{
+  public:
+    // queries in flight per object; a slot whose oldest query is still pending skips a frame
+    static const unsigned int LATENCY = 3;
+
+    struct Stats
+    {
+        unsigned int issued = 0;
+        unsigned int conditional = 0;   // objects drawn under conditional rendering
+        unsigned int hidden = 0;        // results read this frame that found the box hidden
+        unsigned int stallsAvoided = 0; // results not available yet, not waited for
+        unsigned int skipped = 0;       // queries not issued, every query of the slot pending
+    };
+
+    OcclusionQueries() = default;
+    OcclusionQueries(const OcclusionQueries&) = delete;
+    OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+
+    // the box shader takes a unit cube at location 0 and stretches it from boxMin to boxMax
+    void create(const Shader& boxShader)
+    {
+        m_Program = boxShader.ID;
+        m_BoxMin = boxShader.uniform<glm::vec3>("boxMin");
+        m_BoxMax = boxShader.uniform<glm::vec3>("boxMax");
+
+        // the 12 triangles of the unit cube
+        static const float corners[8][3] = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {1, 1, 0},
+                                            {0, 0, 1}, {1, 0, 1}, {0, 1, 1}, {1, 1, 1}};
+        static const unsigned char faces[36] = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6,
+                                                0, 1, 4, 1, 5, 4, 2, 6, 3, 3, 6, 7,
+                                                0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+        float vertices[36][3];
+        for (int i = 0; i < 36; ++i)
+            for (int axis = 0; axis < 3; ++axis)
+                vertices[i][axis] = corners[faces[i]][axis];
+        glGenVertexArrays(1, &m_VAO);
+        glGenBuffers(1, &m_VBO);
+        GLState::Instance().bindVertexArray(m_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)nullptr);
+    }
+
+    void destroy()
+    {
+        for (Slot& slot : m_Slots)
+            glDeleteQueries(LATENCY, slot.queries);
+        m_Slots.clear();
+        if (m_VAO)
+        {
+            glDeleteVertexArrays(1, &m_VAO);
+            GLState::Instance().vertexArrayDeleted(m_VAO);
+        }
+        if (m_VBO)
+            glDeleteBuffers(1, &m_VBO);
+        m_VAO = m_VBO = 0;
+    }
+
+    // collects the results that have come in since the last frame, never waiting for one
+    void beginFrame(size_t objectCount)
+    {
+        while (m_Slots.size() < objectCount)
+        {
+            m_Slots.emplace_back();
+            glGenQueries(LATENCY, m_Slots.back().queries);
+        }
+        m_Stats = Stats();
+        for (Slot& slot : m_Slots)
+        {
+            slot.current = NONE;
+            // oldest first, so the newest available result wins
+            for (unsigned int age = LATENCY; age > 0; --age)
+            {
+                unsigned int index = (slot.next + LATENCY - age) % LATENCY;
+                if (!slot.pending[index])
+                    continue;
+                GLuint available = GL_FALSE;
+                glGetQueryObjectuiv(slot.queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                {
+                    ++m_Stats.stallsAvoided;
+                    continue;
+                }
+                GLuint samples = 0;
+                glGetQueryObjectuiv(slot.queries[index], GL_QUERY_RESULT, &samples);
+                slot.pending[index] = false;
+                slot.visible = samples != 0;
+                if (!slot.visible)
+                    ++m_Stats.hidden;
+            }
+        }
+    }
+
+    // false if the object's box was hidden last frame; such objects are drawn inside
+    // beginConditional() / endConditional() after queryBoxes()
+    bool visibleLastFrame(unsigned int object) const
+    {
+        return object >= m_Slots.size() || m_Slots[object].visible;
+    }
+
+    // draws the boxes of the given objects inside queries. Boxes the camera is inside of would be
+    // clipped by the near plane, so they are not queried and count as visible.
+    void queryBoxes(
+        const std::vector<unsigned int>& objects, const std::vector<Bounds>& bounds,
+        const glm::vec3& cameraPosition)
+    {
+        GLState& state = GLState::Instance();
+        state.useProgram(m_Program);
+        state.bindVertexArray(m_VAO);
+        state.disable(GL_CULL_FACE);
+        state.enable(GL_DEPTH_TEST);
+        state.depthMask(false);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        for (unsigned int object : objects)
+        {
+            Slot& slot = m_Slots[object];
+            const Bounds& box = bounds[object];
+            if (inside(cameraPosition, box))
+            {
+                slot.visible = true;
+                continue;
+            }
+            if (slot.pending[slot.next])
+            {
+                ++m_Stats.skipped;
+                continue;
+            }
+            glUniform3fv(m_BoxMin.location, 1, &box.min[0]);
+            glUniform3fv(m_BoxMax.location, 1, &box.max[0]);
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, slot.queries[slot.next]);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            slot.pending[slot.next] = true;
+            slot.current = slot.next;
+            slot.next = (slot.next + 1) % LATENCY;
+            ++m_Stats.issued;
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        state.depthMask(true);
+    }
+
+    // draws until endConditional() are dropped by the GPU if this frame's box query of object
+    // found no samples. Without a query this frame they are drawn unconditionally.
+    void beginConditional(unsigned int object)
+    {
+        m_Conditional = m_Slots[object].current != NONE;
+        if (!m_Conditional)
+            return;
+        glBeginConditionalRender(
+            m_Slots[object].queries[m_Slots[object].current], GL_QUERY_NO_WAIT);
+        ++m_Stats.conditional;
+    }
+
+    void endConditional()
+    {
+        if (m_Conditional)
+            glEndConditionalRender();
+        m_Conditional = false;
+    }
+
+    const Stats& stats() const { return m_Stats; }
+
+  private:
+    static const unsigned int NONE = ~0u;
+
+    struct Slot
+    {
+        GLuint queries[LATENCY] = {};
+        bool pending[LATENCY] = {};
+        unsigned int next = 0;
+        // query issued this frame, NONE if there is none
+        unsigned int current = NONE;
+        bool visible = true;
+    };
+
+    std::vector<Slot> m_Slots;
+    unsigned int m_Program = 0;
+    Shader::Uniform<glm::vec3> m_BoxMin;
+    Shader::Uniform<glm::vec3> m_BoxMax;
+    unsigned int m_VAO = 0;
+    unsigned int m_VBO = 0;
+    bool m_Conditional = false;
+    Stats m_Stats;
+
+    // with a margin that covers the near plane distance
+    static bool inside(const glm::vec3& point, const Bounds& box)
+    {
+        const float margin = 0.2f;
+        for (int axis = 0; axis < 3; ++axis)
+            if (point[axis] < box.min[axis] - margin || point[axis] > box.max[axis] + margin)
+                return false;
+        return true;
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_OCCLUSIONQUERIES_H
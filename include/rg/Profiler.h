@@ -0,0 +1,315 @@
+#ifndef PROJECT_BASE_PROFILER_H
+#define PROJECT_BASE_PROFILER_H
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define RG_PROFILER_TSC
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rg
+{
+
+// A finished zone; name has static storage (a string literal or __func__)
+struct ProfileEvent
+{
+    const char* name;
+    uint64_t begin;
+    uint64_t end;
+    uint32_t depth;
+};
+
+// Hierarchical CPU profiler. Zones (RG_PROFILE_ZONE) time the rest of their scope with the time
+// stamp counter and go into a ring buffer owned by the thread that ran them, so recording never
+// takes a lock: the owner is the only writer and publishes each event with a release store of
+// the ring's head. Readers copy a ring and drop what the owner overwrote meanwhile. The oldest
+// events fall out of the ring as new ones come in.
+//
+// The main loop marks frames with endFrame(); the ImGui panel shows the last frames from these
+// marks, and writeChromeTrace() saves everything still in the rings for chrome://tracing or
+// Perfetto.
+class Profiler
+{
+  public:
+    // events kept per thread
+    static const uint32_t RING_SIZE = 1 << 14;
+    static const uint32_t FRAME_HISTORY = 256;
+
+    struct ThreadBuffer
+    {
+        ProfileEvent events[RING_SIZE];
+        std::atomic<uint64_t> head{0};
+        std::atomic<const char*> name{"thread"};
+        uint32_t id = 0;
+        // zones open on the owner thread
+        uint32_t depth = 0;
+
+        void push(const ProfileEvent& event)
+        {
+            uint64_t index = head.load(std::memory_order_relaxed);
+            events[index % RING_SIZE] = event;
+            head.store(index + 1, std::memory_order_release);
+        }
+    };
+
+    // the events of one thread, oldest first
+    struct ThreadEvents
+    {
+        uint32_t id;
+        const char* name;
+        std::vector<ProfileEvent> events;
+    };
+
+    static Profiler& Instance()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // ticks of the time stamp counter, nanoseconds where there is none
+    static uint64_t Now()
+    {
+#ifdef RG_PROFILER_TSC
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+
+    bool enabled() const { return m_Enabled.load(std::memory_order_relaxed); }
+    void setEnabled(bool enabled) { m_Enabled.store(enabled, std::memory_order_relaxed); }
+
+    // the calling thread's ring, created on its first zone
+    ThreadBuffer& threadBuffer()
+    {
+        static thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Buffers.emplace_back(new ThreadBuffer);
+            buffer = m_Buffers.back().get();
+            buffer->id = (uint32_t)m_Buffers.size();
+        }
+        return *buffer;
+    }
+
+    // name has static storage; shown for the calling thread in traces and the panel
+    void setThreadName(const char* name) { threadBuffer().name.store(name); }
+
+    // marks the end of a frame; called once per frame by the thread that runs the main loop
+    void endFrame()
+    {
+        uint64_t now = Now();
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_FrameEnds[m_FrameCount % FRAME_HISTORY] = now;
+        ++m_FrameCount;
+        calibrate(now);
+    }
+
+    // the ticks from the start of the frame count frames before the last one ended to its end
+    void frameRange(unsigned int count, uint64_t& from, uint64_t& to) const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        count = std::min(count, FRAME_HISTORY - 1);
+        to = m_FrameCount ? m_FrameEnds[(m_FrameCount - 1) % FRAME_HISTORY] : Now();
+        from = m_FrameCount > count ? m_FrameEnds[(m_FrameCount - 1 - count) % FRAME_HISTORY]
+                                    : m_StartTicks;
+    }
+
+    double nanosecondsPerTick() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_NanosecondsPerTick;
+    }
+
+    // copies the events overlapping [from, to) out of every ring
+    std::vector<ThreadEvents> snapshot(uint64_t from = 0, uint64_t to = ~0ull) const
+    {
+        std::vector<ThreadEvents> threads;
+        std::vector<uint64_t> indices;
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (const std::unique_ptr<ThreadBuffer>& buffer : m_Buffers)
+        {
+            ThreadEvents thread{buffer->id, buffer->name.load(), {}};
+            indices.clear();
+            // events are pushed as they end, so the walk back from the newest stops at the first
+            // one that ended before the range
+            uint64_t head = buffer->head.load(std::memory_order_acquire);
+            uint64_t first = head > RING_SIZE ? head - RING_SIZE : 0;
+            for (uint64_t i = head; i > first; --i)
+            {
+                ProfileEvent event = buffer->events[(i - 1) % RING_SIZE];
+                if (event.end <= from)
+                    break;
+                if (event.begin < to)
+                {
+                    thread.events.push_back(event);
+                    indices.push_back(i - 1);
+                }
+            }
+            // the owner kept writing while the ring was read; drop the slots it may have reused.
+            // The fence keeps the plain reads of the events above from moving below the re-read.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t after = buffer->head.load(std::memory_order_acquire);
+            uint64_t valid = after + 1 > RING_SIZE ? after + 1 - RING_SIZE : 0;
+            size_t keep = 0;
+            while (keep < indices.size() && indices[keep] >= valid)
+                ++keep;
+            thread.events.resize(keep);
+            std::reverse(thread.events.begin(), thread.events.end());
+            threads.push_back(std::move(thread));
+        }
+        return threads;
+    }
+
+    // Chrome trace event format: complete ("X") events with microsecond time stamps
+    bool writeChromeTrace(const std::string& path)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            calibrate(Now());
+        }
+        std::vector<ThreadEvents> threads = snapshot();
+        double microsecondsPerTick = nanosecondsPerTick() / 1000.0;
+        std::ofstream out(path);
+        if (!out)
+            return false;
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+        bool first = true;
+        size_t count = 0;
+        for (const ThreadEvents& thread : threads)
+        {
+            out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                << "\"tid\": " << thread.id << ", \"args\": {\"name\": \""
+                << jsonEscape(thread.name) << "\"}}";
+            first = false;
+            for (const ProfileEvent& event : thread.events)
+            {
+                double start = (double)(event.begin - m_StartTicks) * microsecondsPerTick;
+                double duration = (double)(event.end - event.begin) * microsecondsPerTick;
+                out << ",\n{\"name\": \"" << jsonEscape(event.name)
+                    << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread.id
+                    << ", \"ts\": " << start << ", \"dur\": " << duration << "}";
+            }
+            count += thread.events.size();
+        }
+        out << "\n]}\n";
+        std::cout << "PROFILER:: wrote " << count << " zones to " << path << std::endl;
+        return (bool)out;
+    }
+
+  private:
+    mutable std::mutex m_Mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> m_Buffers;
+    std::atomic<bool> m_Enabled{true};
+    uint64_t m_FrameEnds[FRAME_HISTORY] = {};
+    uint64_t m_FrameCount = 0;
+    uint64_t m_StartTicks = Now();
+    std::chrono::steady_clock::time_point m_StartTime = std::chrono::steady_clock::now();
+    double m_NanosecondsPerTick = 1.0;
+
+    Profiler() = default;
+
+    // zone and thread names are usually identifiers, but __func__ of an operator or a name
+    // given by the caller can hold anything
+    static std::string jsonEscape(const char* text)
+    {
+        static const char hex[] = "0123456789abcdef";
+        std::string escaped;
+        for (const char* c = text; *c; ++c)
+        {
+            if (*c == '"' || *c == '\\')
+            {
+                escaped += '\\';
+                escaped += *c;
+            }
+            else if ((unsigned char)*c < 0x20)
+            {
+                escaped += "\\u00";
+                escaped += hex[(unsigned char)*c >> 4];
+                escaped += hex[*c & 15];
+            }
+            else
+                escaped += *c;
+        }
+        return escaped;
+    }
+
+    // the tick rate is measured against the steady clock over the whole run, so it gets more
+    // precise the longer the program runs and costs nothing at startup
+    void calibrate(uint64_t now)
+    {
+#ifdef RG_PROFILER_TSC
+        double elapsed = std::chrono::duration<double, std::nano>(
+                             std::chrono::steady_clock::now() - m_StartTime)
+                             .count();
+        if (elapsed > 1e6 && now > m_StartTicks)
+            m_NanosecondsPerTick = elapsed / (double)(now - m_StartTicks);
+#endif
+    }
+};
+
+// Times its scope into the profiler; see RG_PROFILE_ZONE
+class ProfileZone
+{
+  public:
+    explicit ProfileZone(const char* name) : m_Name(name)
+    {
+        Profiler& profiler = Profiler::Instance();
+        if (!profiler.enabled())
+            return;
+        m_Buffer = &profiler.threadBuffer();
+        m_Depth = m_Buffer->depth++;
+        m_Begin = Profiler::Now();
+    }
+
+    ~ProfileZone()
+    {
+        if (!m_Buffer)
+            return;
+        uint64_t end = Profiler::Now();
+        --m_Buffer->depth;
+        m_Buffer->push(ProfileEvent{m_Name, m_Begin, end, m_Depth});
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+  private:
+    const char* m_Name;
+    Profiler::ThreadBuffer* m_Buffer = nullptr;
+    uint64_t m_Begin = 0;
+    uint32_t m_Depth = 0;
+};
+
+}; // namespace rg
+
+// RG_PROFILE_ZONE("name") times the rest of the enclosing scope. Builds with
+// RG_PROFILER_DISABLED defined compile the zones out.
+#define RG_PROFILE_CONCAT_(a, b) a##b
+#define RG_PROFILE_CONCAT(a, b) RG_PROFILE_CONCAT_(a, b)
+#ifndef RG_PROFILER_DISABLED
+#define RG_PROFILE_ZONE(name) rg::ProfileZone RG_PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define RG_PROFILE_ZONE(name)                                                                      \
+    do                                                                                             \
+    {                                                                                              \
+    } while (0)
+#endif
+#define RG_PROFILE_FUNCTION() RG_PROFILE_ZONE(__func__)
+
+#endif // PROJECT_BASE_PROFILER_H
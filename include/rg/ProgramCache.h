@@ -0,0 +1,202 @@
+#ifndef PROJECT_BASE_PROGRAMCACHE_H
+#define PROJECT_BASE_PROGRAMCACHE_H
+
+#include <glad/glad.h>
+
+#include <rg/Hash.h>
+#include <rg/MappedFile.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// ARB_get_program_binary (core in 4.1); the bundled glad only covers 3.3
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+namespace rg
+{
+
+// On-disk cache of linked shader programs (glGetProgramBinary / glProgramBinary), stored next to
+// the vertex shader as <shader>.<variant>.progbin. An entry is keyed by a hash of all stage
+// sources, the defines and the GL vendor/renderer/version strings, so a driver update or an
+// edited shader falls back to compiling from source and replaces the entry.
+//
+// Disabled until init() finds ARB_get_program_binary with at least one binary format.
+class ProgramCache
+{
+  public:
+    static const uint32_t VERSION = 1;
+
+    struct Stats
+    {
+        unsigned int hits = 0;
+        unsigned int misses = 0;
+    };
+
+    static ProgramCache& Instance()
+    {
+        static ProgramCache instance;
+        return instance;
+    }
+
+    // resolves the entry points; call once after gladLoadGLLoader with the same loader
+    void init(GLADloadproc load)
+    {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        bool supported = major > 4 || (major == 4 && minor >= 1);
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (GLint i = 0; i < extensionCount && !supported; ++i)
+        {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (name && std::strcmp(name, "GL_ARB_get_program_binary") == 0)
+                supported = true;
+        }
+        if (!supported)
+            return;
+
+        m_GetProgramBinary = (GetProgramBinaryProc)load("glGetProgramBinary");
+        m_ProgramBinary = (ProgramBinaryProc)load("glProgramBinary");
+        m_ProgramParameteri = (ProgramParameteriProc)load("glProgramParameteri");
+        // drivers may expose the extension without any format they can save
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        m_Enabled = m_GetProgramBinary && m_ProgramBinary && m_ProgramParameteri && formatCount > 0;
+
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            const char* value = (const char*)glGetString(name);
+            m_Driver += value ? value : "";
+            m_Driver += '\n';
+        }
+    }
+
+    bool enabled() const { return m_Enabled; }
+
+    // sources: every stage's final source text, in a fixed order; defines are part of them
+    uint64_t key(const std::vector<std::string>& sources) const
+    {
+        uint64_t hash = fnv1a64(m_Driver);
+        for (const std::string& source : sources)
+        {
+            uint64_t length = source.size();
+            hash = fnv1a64(&length, sizeof(length), hash);
+            hash = fnv1a64(source, hash);
+        }
+        return hash;
+    }
+
+    static std::string CachePathFor(const std::string& vertexPath, const std::string& variant)
+    {
+        char suffix[24];
+        std::snprintf(suffix, sizeof(suffix), ".%016llx", (unsigned long long)fnv1a64(variant));
+        return vertexPath + suffix + ".progbin";
+    }
+
+    // loads the cached binary into program; false on a miss, a stale entry or a binary the
+    // driver rejects, after which the program can still be linked from source
+    bool load(const std::string& cachePath, uint64_t key, unsigned int program)
+    {
+        if (!m_Enabled)
+            return false;
+        MappedFile file;
+        Header header;
+        bool linked = false;
+        if (file.open(cachePath) && file.size() >= sizeof(Header))
+        {
+            std::memcpy(&header, file.data(), sizeof(header));
+            if (std::memcmp(header.magic, "RGPB", 4) == 0 && header.version == VERSION &&
+                header.key == key && header.length == file.size() - sizeof(Header))
+            {
+                m_ProgramBinary(
+                    program, header.format, file.data() + sizeof(Header), (GLsizei)header.length);
+                GLint status = GL_FALSE;
+                glGetProgramiv(program, GL_LINK_STATUS, &status);
+                linked = status == GL_TRUE;
+            }
+        }
+        ++(linked ? m_Stats.hits : m_Stats.misses);
+        return linked;
+    }
+
+    // call before glLinkProgram on programs that are going to be stored
+    void prepare(unsigned int program)
+    {
+        if (m_Enabled)
+            m_ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    void store(const std::string& cachePath, uint64_t key, unsigned int program)
+    {
+        if (!m_Enabled)
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        Header header;
+        std::memcpy(header.magic, "RGPB", 4);
+        header.version = VERSION;
+        header.key = key;
+        m_GetProgramBinary(program, length, nullptr, &header.format, binary.data());
+        header.length = length;
+
+        // write to a temporary file and rename it, so readers never see a partial binary
+        std::string tmpPath = cachePath + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(binary.data(), binary.size());
+            if (!out)
+            {
+                std::remove(tmpPath.c_str());
+                return;
+            }
+        }
+        std::rename(tmpPath.c_str(), cachePath.c_str());
+    }
+
+    const Stats& stats() const { return m_Stats; }
+
+  private:
+    typedef void(APIENTRYP GetProgramBinaryProc)(
+        GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+    typedef void(APIENTRYP ProgramBinaryProc)(
+        GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+    typedef void(APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t format;
+        uint32_t length;
+        uint64_t key;
+    };
+
+    bool m_Enabled = false;
+    std::string m_Driver;
+    GetProgramBinaryProc m_GetProgramBinary = nullptr;
+    ProgramBinaryProc m_ProgramBinary = nullptr;
+    ProgramParameteriProc m_ProgramParameteri = nullptr;
+    Stats m_Stats;
+
+    ProgramCache() = default;
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_PROGRAMCACHE_H
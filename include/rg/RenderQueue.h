@@ -0,0 +1,310 @@
+#ifndef PROJECT_BASE_RENDERQUEUE_H
+#define PROJECT_BASE_RENDERQUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <rg/GLState.h>
+#include <rg/Hash.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace rg
+{
+
+// textures of one material
+const unsigned int MAX_TEXTURE_UNITS = 8;
+
+// passes run in this order; transparent packets are sorted back to front
+enum class RenderPass : unsigned int
+{
+    Opaque = 0,
+    Transparent = 1
+};
+
+// One draw, with its state given as indices into the tables of the queue it is submitted to.
+// draw(object, argument) issues the draw call itself plus any uniforms that are specific to the
+// object; it must not change program, vertex array, texture or culling state.
+struct DrawPacket
+{
+    unsigned int program = 0;
+    unsigned int vao = 0;
+    unsigned int material = 0;
+    unsigned int transform = NO_TRANSFORM;
+    bool cullFace = false;
+    void (*draw)(const void* object, unsigned int argument) = nullptr;
+    const void* object = nullptr;
+    unsigned int argument = 0;
+
+    static const unsigned int NO_TRANSFORM = ~0u;
+};
+
+// Collects the draws of a frame, sorts them by a 64-bit key and executes them, skipping every
+// state change that is already in effect. From the most significant bits down the key holds the
+// pass, program, culling, vertex array, material and depth, so the expensive changes happen
+// least often and opaque draws with equal state go front to back.
+//
+// Programs, vertex arrays and materials are interned per frame into dense indices; the key has
+// room for 1024 programs, 256 vertex arrays and 512k materials. Indices past that share the
+// last value of their field: they still draw with their own state, just without being sorted
+// apart, and are counted in Stats::keyOverflows.
+class RenderQueue
+{
+  public:
+    struct StateChanges
+    {
+        unsigned int programs = 0;
+        unsigned int vertexArrays = 0;
+        unsigned int textures = 0;
+    };
+
+    struct Stats
+    {
+        unsigned int packets = 0;
+        // binds if every packet set all of its state ...
+        StateChanges submitted;
+        // ... and the ones left after sorting and skipping redundant changes
+        StateChanges issued;
+        unsigned int cullChanges = 0;
+        unsigned int transforms = 0;
+        // packets with an index too large for its field of the key
+        unsigned int keyOverflows = 0;
+    };
+
+    // starts a new frame; depths passed to submit are expected in [0, maxDepth]
+    void reset(float maxDepth)
+    {
+        m_MaxDepth = maxDepth;
+        m_Packets.clear();
+        m_Keys.clear();
+        m_Programs.clear();
+        m_VertexArrays.clear();
+        m_Materials.clear();
+        m_MaterialIndex.clear();
+        m_Transforms.clear();
+        m_Stats = Stats();
+    }
+
+    // modelLocation: where the program takes the transform of a packet, -1 for none
+    unsigned int addProgram(unsigned int program, GLint modelLocation)
+    {
+        for (unsigned int i = 0; i < m_Programs.size(); ++i)
+            if (m_Programs[i].id == program)
+                return i;
+        m_Programs.push_back(Program{program, modelLocation});
+        return (unsigned int)m_Programs.size() - 1;
+    }
+
+    unsigned int addVertexArray(unsigned int vao)
+    {
+        auto it = std::find(m_VertexArrays.begin(), m_VertexArrays.end(), vao);
+        if (it != m_VertexArrays.end())
+            return (unsigned int)(it - m_VertexArrays.begin());
+        m_VertexArrays.push_back(vao);
+        return (unsigned int)m_VertexArrays.size() - 1;
+    }
+
+    // 2D textures and the unit each is bound to, which is where the program the material is drawn
+    // with has the texture's sampler (Shader::samplerUnit); textures with a negative unit are
+    // left out. Equal materials share an index, so their draws sort together.
+    unsigned int addMaterial(const unsigned int* textures, const GLint* units, unsigned int count)
+    {
+        Material material;
+        material.count = std::min(count, MAX_TEXTURE_UNITS);
+        for (unsigned int i = 0; i < material.count; ++i)
+        {
+            material.textures[i] = textures[i];
+            material.units[i] = units[i];
+        }
+        uint64_t hash = fnv1a64(&material, sizeof(material));
+        auto range = m_MaterialIndex.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+            if (std::memcmp(&m_Materials[it->second], &material, sizeof(material)) == 0)
+                return it->second;
+        m_Materials.push_back(material);
+        unsigned int index = (unsigned int)m_Materials.size() - 1;
+        m_MaterialIndex.emplace(hash, index);
+        return index;
+    }
+
+    unsigned int addTransform(const glm::mat4& transform)
+    {
+        m_Transforms.push_back(transform);
+        return (unsigned int)m_Transforms.size() - 1;
+    }
+
+    // depth: distance from the camera
+    void submit(const DrawPacket& packet, RenderPass pass, float depth)
+    {
+        float normalized = m_MaxDepth > 0.0f ? depth / m_MaxDepth : 0.0f;
+        uint64_t quantized = (uint64_t)(std::min(std::max(normalized, 0.0f), 1.0f) * DEPTH_MASK);
+        if (pass == RenderPass::Transparent)
+            quantized = DEPTH_MASK - quantized;
+
+        uint64_t program = packet.program, vao = packet.vao, material = packet.material;
+        if (program > PROGRAM_MASK || vao > VAO_MASK || material > MATERIAL_MASK)
+        {
+            program = std::min(program, (uint64_t)PROGRAM_MASK);
+            vao = std::min(vao, (uint64_t)VAO_MASK);
+            material = std::min(material, (uint64_t)MATERIAL_MASK);
+            ++m_Stats.keyOverflows;
+        }
+        uint64_t key = (uint64_t)pass << 62 | program << 52 | (uint64_t)packet.cullFace << 51 |
+                       vao << 43 | material << 24 | quantized;
+        m_Keys.push_back(SortEntry{key, (unsigned int)m_Packets.size()});
+        m_Packets.push_back(packet);
+    }
+
+    // sorts and draws everything submitted since reset(). State goes through GLState and is left
+    // as the last packet set it.
+    void execute() { execute([](RenderPass) {}); }
+
+    // the same, calling beginPass(pass) before the first draw of every pass that has draws.
+    // beginPass may draw things of its own in between passes.
+    template <typename PassF> void execute(PassF beginPass)
+    {
+        sort();
+
+        GLState& state = GLState::Instance();
+        const unsigned int NONE = ~0u;
+        unsigned int program = NONE, vao = NONE, material = NONE, transform = NONE;
+        int cullFace = -1;
+        unsigned int bound[GLState::MAX_UNITS];
+        std::fill(bound, bound + GLState::MAX_UNITS, NONE);
+
+        m_Stats.packets = (unsigned int)m_Keys.size();
+        unsigned int pass = NONE;
+        for (const SortEntry& entry : m_Keys)
+        {
+            if ((unsigned int)(entry.key >> 62) != pass)
+            {
+                pass = (unsigned int)(entry.key >> 62);
+                beginPass((RenderPass)pass);
+                // whatever beginPass drew left its own state behind
+                program = vao = material = transform = NONE;
+                cullFace = -1;
+                std::fill(bound, bound + GLState::MAX_UNITS, NONE);
+            }
+            const DrawPacket& packet = m_Packets[entry.packet];
+            const Material& packetMaterial = m_Materials[packet.material];
+            ++m_Stats.submitted.programs;
+            ++m_Stats.submitted.vertexArrays;
+            m_Stats.submitted.textures += packetMaterial.count;
+
+            if (packet.program != program)
+            {
+                program = packet.program;
+                state.useProgram(m_Programs[program].id);
+                ++m_Stats.issued.programs;
+                // the transform uniform belongs to the program
+                transform = NONE;
+            }
+            if ((int)packet.cullFace != cullFace)
+            {
+                cullFace = packet.cullFace;
+                state.setEnabled(GL_CULL_FACE, packet.cullFace);
+                ++m_Stats.cullChanges;
+            }
+            if (packet.vao != vao)
+            {
+                vao = packet.vao;
+                state.bindVertexArray(m_VertexArrays[vao]);
+                ++m_Stats.issued.vertexArrays;
+            }
+            if (packet.material != material)
+            {
+                material = packet.material;
+                for (unsigned int i = 0; i < packetMaterial.count; ++i)
+                {
+                    GLint unit = packetMaterial.units[i];
+                    if (unit < 0 || bound[unit] == packetMaterial.textures[i])
+                        continue;
+                    state.bindTexture(unit, GL_TEXTURE_2D, packetMaterial.textures[i]);
+                    bound[unit] = packetMaterial.textures[i];
+                    ++m_Stats.issued.textures;
+                }
+            }
+            GLint modelLocation = m_Programs[program].modelLocation;
+            if (packet.transform != transform && packet.transform != DrawPacket::NO_TRANSFORM &&
+                modelLocation >= 0)
+            {
+                transform = packet.transform;
+                glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &m_Transforms[transform][0][0]);
+                ++m_Stats.transforms;
+            }
+            packet.draw(packet.object, packet.argument);
+        }
+    }
+
+    const Stats& stats() const { return m_Stats; }
+
+    // puts what was submitted in execution order, as execute() does before drawing. LSD radix
+    // sort on the key, one byte per pass; stable, so submission order breaks ties. Passes over a
+    // byte all keys share are skipped, which with few programs and vertex arrays is most of the
+    // high ones.
+    void sort()
+    {
+        const size_t count = m_Keys.size();
+        m_Scratch.resize(count);
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            size_t offsets[256] = {};
+            for (const SortEntry& entry : m_Keys)
+                ++offsets[(entry.key >> shift) & 0xff];
+            if (count == 0 || offsets[(m_Keys[0].key >> shift) & 0xff] == count)
+                continue;
+            size_t sum = 0;
+            for (size_t& offset : offsets)
+            {
+                size_t bucket = offset;
+                offset = sum;
+                sum += bucket;
+            }
+            for (const SortEntry& entry : m_Keys)
+                m_Scratch[offsets[(entry.key >> shift) & 0xff]++] = entry;
+            m_Keys.swap(m_Scratch);
+        }
+    }
+
+  private:
+    static const uint64_t PROGRAM_MASK = (1u << 10) - 1;
+    static const uint64_t VAO_MASK = (1u << 8) - 1;
+    static const uint64_t MATERIAL_MASK = (1u << 19) - 1;
+    static const uint64_t DEPTH_MASK = (1u << 24) - 1;
+
+    struct Program
+    {
+        unsigned int id;
+        GLint modelLocation;
+    };
+
+    struct Material
+    {
+        unsigned int count = 0;
+        unsigned int textures[MAX_TEXTURE_UNITS] = {};
+        GLint units[MAX_TEXTURE_UNITS] = {};
+    };
+
+    struct SortEntry
+    {
+        uint64_t key;
+        unsigned int packet;
+    };
+
+    float m_MaxDepth = 1.0f;
+    std::vector<DrawPacket> m_Packets;
+    std::vector<SortEntry> m_Keys, m_Scratch;
+    std::vector<Program> m_Programs;
+    std::vector<unsigned int> m_VertexArrays;
+    std::vector<Material> m_Materials;
+    std::unordered_multimap<uint64_t, unsigned int> m_MaterialIndex;
+    std::vector<glm::mat4> m_Transforms;
+    Stats m_Stats;
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_RENDERQUEUE_H
@@ -0,0 +1,379 @@
+#ifndef PROJECT_BASE_SOFTWAREOCCLUSION_H
+#define PROJECT_BASE_SOFTWAREOCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include <rg/Bounds.h>
+#include <rg/ThreadPool.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RG_OCCLUSION_SSE2 1
+#endif
+
+namespace rg
+{
+
+// Low-poly stand-in for a mesh, rendered into the occlusion buffer instead of the real geometry.
+// It has to stay inside the surface it replaces, or it hides things that are visible.
+struct Occluder
+{
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    // object space
+    Bounds bounds;
+
+    bool empty() const { return indices.empty(); }
+};
+
+// what the occlusion pass did in the last frame
+struct OcclusionStats
+{
+    unsigned int occluders = 0;
+    unsigned int triangles = 0; // after clipping, as rasterized
+    unsigned int tested = 0;
+    unsigned int occluded = 0;
+    double transformMs = 0.0;
+    double rasterizeMs = 0.0;
+    double testMs = 0.0;
+
+    void reset() { *this = OcclusionStats(); }
+};
+
+// CPU occlusion culling on a coarse depth buffer. Occluders are transformed, near clipped and
+// binned into screen tiles by begin()/addOccluder(); rasterize() then fills the tiles
+// independently, spread over a thread pool, four pixels at a time with SSE2. Afterwards
+// visible() tests world space boxes against the buffer: a box is hidden when every pixel its
+// screen rectangle touches holds an occluder nearer than the nearest point of the box. Each
+// 8x8 block keeps its farthest depth, so most boxes are decided from a few blocks.
+//
+// Everything is plain CPU code without GL, so it runs the same headless. Depth is z / w mapped
+// to [0, 1], nearer is smaller; row 0 is the bottom of the screen.
+class SoftwareOcclusion
+{
+  public:
+    static const int WIDTH = 320;
+    static const int HEIGHT = 192;
+    static const int TILE_WIDTH = 64;
+    static const int TILE_HEIGHT = 64;
+    static const int TILES_X = WIDTH / TILE_WIDTH;
+    static const int TILES_Y = HEIGHT / TILE_HEIGHT;
+    static const int BLOCK_SIZE = 8;
+    static const int BLOCKS_X = WIDTH / BLOCK_SIZE;
+    static const int BLOCKS_Y = HEIGHT / BLOCK_SIZE;
+
+    SoftwareOcclusion()
+        : m_Bins(TILES_X * TILES_Y), m_Depth(WIDTH * HEIGHT, 1.0f),
+          m_BlockMax(BLOCKS_X * BLOCKS_Y, 1.0f)
+    {
+    }
+
+    // starts a frame: forgets the occluders and stats of the previous one
+    void begin(const glm::mat4& viewProjection)
+    {
+        m_ViewProjection = viewProjection;
+        m_Triangles.clear();
+        for (std::vector<unsigned int>& bin : m_Bins)
+            bin.clear();
+        m_Stats.reset();
+    }
+
+    void addOccluder(const Occluder& occluder, const glm::mat4& model)
+    {
+        Clock::time_point start = Clock::now();
+        glm::mat4 transform = m_ViewProjection * model;
+        m_Clip.resize(occluder.positions.size());
+        for (size_t i = 0; i < occluder.positions.size(); ++i)
+            m_Clip[i] = transform * glm::vec4(occluder.positions[i], 1.0f);
+        for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3)
+            addTriangle(
+                m_Clip[occluder.indices[i]], m_Clip[occluder.indices[i + 1]],
+                m_Clip[occluder.indices[i + 2]]);
+        ++m_Stats.occluders;
+        m_Stats.transformMs += elapsedMs(start);
+    }
+
+    // fills the depth buffer from the binned triangles, one tile per task
+    void rasterize(ThreadPool* pool = nullptr)
+    {
+        Clock::time_point start = Clock::now();
+        auto tile = [this](size_t index) { rasterizeTile((int)index); };
+        if (pool)
+            pool->parallelFor(m_Bins.size(), tile);
+        else
+            for (size_t i = 0; i < m_Bins.size(); ++i)
+                tile(i);
+        m_Stats.triangles = (unsigned int)m_Triangles.size();
+        m_Stats.rasterizeMs = elapsedMs(start);
+    }
+
+    // false if the box is certainly hidden behind the occluders; boxes reaching behind the
+    // camera or off the screen count as visible
+    bool visible(const Bounds& world)
+    {
+        Clock::time_point start = Clock::now();
+        bool result = testBox(world);
+        ++m_Stats.tested;
+        if (!result)
+            ++m_Stats.occluded;
+        m_Stats.testMs += elapsedMs(start);
+        return result;
+    }
+
+    const OcclusionStats& stats() const { return m_Stats; }
+    // WIDTH * HEIGHT depths, bottom row first
+    const std::vector<float>& depth() const { return m_Depth; }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    // screen space triangle, counter-clockwise, with its pixel bounds
+    struct Triangle
+    {
+        glm::vec3 v[3]; // x, y in pixels, z depth
+        int minX, minY, maxX, maxY;
+    };
+
+    // anything nearer than this to the camera plane is clipped away
+    static constexpr float NEAR_W = 1e-5f;
+
+    glm::mat4 m_ViewProjection = glm::mat4(1.0f);
+    std::vector<glm::vec4> m_Clip;
+    std::vector<Triangle> m_Triangles;
+    std::vector<std::vector<unsigned int>> m_Bins;
+    std::vector<float> m_Depth;
+    std::vector<float> m_BlockMax;
+    OcclusionStats m_Stats;
+
+    static double elapsedMs(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    void addTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+    {
+        // entirely outside one of the side or far planes
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (a[axis] > a.w && b[axis] > b.w && c[axis] > c.w)
+                return;
+            if (axis < 2 && a[axis] < -a.w && b[axis] < -b.w && c[axis] < -c.w)
+                return;
+        }
+
+        // clip against the near plane, z >= -w; a triangle becomes at most a quad
+        const glm::vec4* in[3] = {&a, &b, &c};
+        glm::vec4 polygon[4];
+        int count = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            const glm::vec4& p = *in[i];
+            const glm::vec4& q = *in[(i + 1) % 3];
+            float dp = p.z + p.w;
+            float dq = q.z + q.w;
+            if (dp >= 0.0f)
+                polygon[count++] = p;
+            if ((dp >= 0.0f) != (dq >= 0.0f))
+                polygon[count++] = p + (q - p) * (dp / (dp - dq));
+        }
+        if (count < 3)
+            return;
+
+        glm::vec3 screen[4];
+        for (int i = 0; i < count; ++i)
+        {
+            float w = polygon[i].w > NEAR_W ? polygon[i].w : NEAR_W;
+            screen[i] = glm::vec3(
+                (polygon[i].x / w * 0.5f + 0.5f) * WIDTH, (polygon[i].y / w * 0.5f + 0.5f) * HEIGHT,
+                polygon[i].z / w * 0.5f + 0.5f);
+        }
+        addScreenTriangle(screen[0], screen[1], screen[2]);
+        if (count == 4)
+            addScreenTriangle(screen[0], screen[2], screen[3]);
+    }
+
+    void addScreenTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c)
+    {
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (area == 0.0f)
+            return;
+        // occluders are two sided
+        if (area < 0.0f)
+            std::swap(b, c);
+
+        Triangle triangle;
+        triangle.v[0] = a;
+        triangle.v[1] = b;
+        triangle.v[2] = c;
+        // pixels whose centers the triangle may cover
+        float minX = std::min(a.x, std::min(b.x, c.x));
+        float maxX = std::max(a.x, std::max(b.x, c.x));
+        float minY = std::min(a.y, std::min(b.y, c.y));
+        float maxY = std::max(a.y, std::max(b.y, c.y));
+        triangle.minX = std::max((int)std::ceil(minX - 0.5f), 0);
+        triangle.maxX = std::min((int)std::floor(maxX - 0.5f), WIDTH - 1);
+        triangle.minY = std::max((int)std::ceil(minY - 0.5f), 0);
+        triangle.maxY = std::min((int)std::floor(maxY - 0.5f), HEIGHT - 1);
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            return;
+
+        unsigned int index = (unsigned int)m_Triangles.size();
+        m_Triangles.push_back(triangle);
+        for (int ty = triangle.minY / TILE_HEIGHT; ty <= triangle.maxY / TILE_HEIGHT; ++ty)
+            for (int tx = triangle.minX / TILE_WIDTH; tx <= triangle.maxX / TILE_WIDTH; ++tx)
+                m_Bins[ty * TILES_X + tx].push_back(index);
+    }
+
+    // only writes inside the tile, so tiles can be filled concurrently
+    void rasterizeTile(int tile)
+    {
+        int tileX = (tile % TILES_X) * TILE_WIDTH;
+        int tileY = (tile / TILES_X) * TILE_HEIGHT;
+        for (int y = tileY; y < tileY + TILE_HEIGHT; ++y)
+            std::fill_n(&m_Depth[y * WIDTH + tileX], TILE_WIDTH, 1.0f);
+
+        for (unsigned int index : m_Bins[tile])
+        {
+            const Triangle& t = m_Triangles[index];
+            int minX = std::max(t.minX, tileX);
+            int maxX = std::min(t.maxX, tileX + TILE_WIDTH - 1);
+            int minY = std::max(t.minY, tileY);
+            int maxY = std::min(t.maxY, tileY + TILE_HEIGHT - 1);
+            if (minX > maxX || minY > maxY)
+                continue;
+
+            // edge functions e = A x + B y + C, non-negative inside
+            float edgeA[3], edgeB[3], edgeC[3];
+            for (int e = 0; e < 3; ++e)
+            {
+                const glm::vec3& p = t.v[e];
+                const glm::vec3& q = t.v[(e + 1) % 3];
+                edgeA[e] = p.y - q.y;
+                edgeB[e] = q.x - p.x;
+                edgeC[e] = p.x * q.y - p.y * q.x;
+            }
+            // depth is linear in screen space: z = zA x + zB y + zC
+            const glm::vec3& v0 = t.v[0];
+            glm::vec3 e1 = t.v[1] - v0;
+            glm::vec3 e2 = t.v[2] - v0;
+            float inverseArea = 1.0f / (e1.x * e2.y - e1.y * e2.x);
+            float zA = (e1.z * e2.y - e2.z * e1.y) * inverseArea;
+            float zB = (e2.z * e1.x - e1.z * e2.x) * inverseArea;
+            float zC = v0.z - zA * v0.x - zB * v0.y;
+
+            // groups of four start at multiples of four, which tiles are aligned to
+            int startX = minX & ~3;
+            for (int y = minY; y <= maxY; ++y)
+            {
+                float py = y + 0.5f;
+                float* row = &m_Depth[y * WIDTH];
+#ifdef RG_OCCLUSION_SSE2
+                const __m128 zero = _mm_setzero_ps();
+                __m128 px = _mm_add_ps(
+                    _mm_set1_ps(startX + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+                __m128 rowEdge[3];
+                for (int e = 0; e < 3; ++e)
+                    rowEdge[e] = _mm_set1_ps(edgeB[e] * py + edgeC[e]);
+                __m128 rowZ = _mm_set1_ps(zB * py + zC);
+                for (int x = startX; x <= maxX; x += 4)
+                {
+                    __m128 inside = _mm_cmpge_ps(
+                        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[0]), px), rowEdge[0]), zero);
+                    inside = _mm_and_ps(
+                        inside,
+                        _mm_cmpge_ps(
+                            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[1]), px), rowEdge[1]), zero));
+                    inside = _mm_and_ps(
+                        inside,
+                        _mm_cmpge_ps(
+                            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[2]), px), rowEdge[2]), zero));
+                    if (_mm_movemask_ps(inside))
+                    {
+                        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), rowZ);
+                        __m128 old = _mm_loadu_ps(row + x);
+                        __m128 nearer = _mm_min_ps(old, z);
+                        _mm_storeu_ps(
+                            row + x,
+                            _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                    }
+                    px = _mm_add_ps(px, _mm_set1_ps(4.0f));
+                }
+#else
+                for (int x = startX; x <= maxX; ++x)
+                {
+                    float px = x + 0.5f;
+                    bool inside = true;
+                    for (int e = 0; e < 3; ++e)
+                        inside = inside && edgeA[e] * px + edgeB[e] * py + edgeC[e] >= 0.0f;
+                    if (inside)
+                        row[x] = std::min(row[x], zA * px + zB * py + zC);
+                }
+#endif
+            }
+        }
+
+        for (int by = tileY / BLOCK_SIZE; by < (tileY + TILE_HEIGHT) / BLOCK_SIZE; ++by)
+            for (int bx = tileX / BLOCK_SIZE; bx < (tileX + TILE_WIDTH) / BLOCK_SIZE; ++bx)
+            {
+                float farthest = 0.0f;
+                for (int y = by * BLOCK_SIZE; y < (by + 1) * BLOCK_SIZE; ++y)
+                    for (int x = bx * BLOCK_SIZE; x < (bx + 1) * BLOCK_SIZE; ++x)
+                        farthest = std::max(farthest, m_Depth[y * WIDTH + x]);
+                m_BlockMax[by * BLOCKS_X + bx] = farthest;
+            }
+    }
+
+    bool testBox(const Bounds& world) const
+    {
+        if (world.empty())
+            return true;
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        float nearest = FLT_MAX;
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            glm::vec3 p(
+                corner & 1 ? world.max.x : world.min.x, corner & 2 ? world.max.y : world.min.y,
+                corner & 4 ? world.max.z : world.min.z);
+            glm::vec4 clip = m_ViewProjection * glm::vec4(p, 1.0f);
+            if (clip.z < -clip.w || clip.w <= NEAR_W)
+                return true;
+            float x = (clip.x / clip.w * 0.5f + 0.5f) * WIDTH;
+            float y = (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            nearest = std::min(nearest, clip.z / clip.w * 0.5f + 0.5f);
+        }
+        // every pixel the rectangle touches
+        int x0 = std::max((int)std::floor(minX), 0);
+        int x1 = std::min((int)std::floor(maxX), WIDTH - 1);
+        int y0 = std::max((int)std::floor(minY), 0);
+        int y1 = std::min((int)std::floor(maxY), HEIGHT - 1);
+        if (x0 > x1 || y0 > y1)
+            return true;
+
+        for (int by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; ++by)
+            for (int bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; ++bx)
+            {
+                if (m_BlockMax[by * BLOCKS_X + bx] < nearest)
+                    continue;
+                // the block has something farther than the box; look at the pixels in range
+                int yEnd = std::min((by + 1) * BLOCK_SIZE - 1, y1);
+                int xEnd = std::min((bx + 1) * BLOCK_SIZE - 1, x1);
+                for (int y = std::max(by * BLOCK_SIZE, y0); y <= yEnd; ++y)
+                    for (int x = std::max(bx * BLOCK_SIZE, x0); x <= xEnd; ++x)
+                        if (m_Depth[y * WIDTH + x] >= nearest)
+                            return true;
+            }
+        return false;
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_SOFTWAREOCCLUSION_H
@@ -0,0 +1,558 @@
+#ifndef PROJECT_BASE_TEXTUREPIPELINE_H
+#define PROJECT_BASE_TEXTUREPIPELINE_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <rg/BlockCompression.h>
+#include <rg/CompressedTextureCache.h>
+#include <rg/GLState.h>
+#include <rg/Hash.h>
+#include <rg/MappedFile.h>
+#include <rg/Profiler.h>
+#include <rg/ThreadPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace rg
+{
+
+enum class TextureCompression
+{
+    None,
+    // BC1, or BC3 when the image has non-opaque alpha
+    Color,
+    // BC5 with the X/Y components in red/green; shaders rebuild Z
+    NormalMap
+};
+
+struct TextureOptions
+{
+    // flip rows so the first row of the file ends up at t = 1 (stbi_set_flip_vertically_on_load)
+    bool flip = true;
+    bool mipmaps = true;
+    // GL_CLAMP_TO_EDGE for images with an alpha channel, to avoid semi-transparent borders
+    bool clampAlpha = false;
+    // GL_CLAMP_TO_EDGE regardless of the image format (cubemaps)
+    bool clamp = false;
+    // cook into a block compressed format with a full mip chain (2D textures only). The result
+    // is cached next to the source image.
+    TextureCompression compression = TextureCompression::None;
+};
+
+// Asynchronous texture loading. Image files are decoded with stb_image on the worker pool and
+// the decoded pixels wait in a bounded queue until the render thread uploads them with
+// drainUploads(), which respects a per-frame time budget. Texture names are handed out right
+// away, so meshes can reference them before their contents arrive.
+//
+// Decoding never uses stb's global flip flag (it is not thread-safe); TextureOptions::flip is
+// applied per image instead.
+//
+// Compressed textures are cooked on the workers as well (decode, mip chain, BC encode) and stored
+// in a CompressedTextureCache, so later runs skip decoding entirely and upload the cached blocks
+// with glCompressedTexImage2D.
+class TexturePipeline
+{
+  public:
+    struct Stats
+    {
+        unsigned int requested = 0;
+        unsigned int uploaded = 0;
+        unsigned int failed = 0;
+        // summed over all workers
+        double decodeMs = 0.0;
+        // render thread time spent in glTexImage2D/glGenerateMipmap
+        double uploadMs = 0.0;
+        // block compressed textures loaded from the cache / cooked this run
+        unsigned int compressedCacheHits = 0;
+        unsigned int compressedCooked = 0;
+        // estimated VRAM of uploaded textures including mips, and what it would have been with
+        // uncompressed RGB(A)8
+        size_t uploadedBytes = 0;
+        size_t uncompressedBytes = 0;
+    };
+
+    // maxQueuedImages bounds how many decoded images (in flight or waiting for upload) may exist
+    // at once, which caps the memory held by decoded pixels.
+    explicit TexturePipeline(ThreadPool& pool, unsigned int maxQueuedImages = 0)
+        : m_Pool(pool), m_MaxQueued(maxQueuedImages ? maxQueuedImages : 2 * pool.size())
+    {
+        // RGTC (BC5) is core since 3.0, S3TC (BC1/BC3) is an extension
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (GLint i = 0; i < extensionCount; ++i)
+        {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+                m_HasS3TC = true;
+        }
+    }
+
+    // waits for decodes still running on the pool, they reference this object
+    ~TexturePipeline()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_ReadyCondition.wait(lock, [this] { return m_Ready.size() == m_InFlight; });
+    }
+
+    TexturePipeline(const TexturePipeline&) = delete;
+    TexturePipeline& operator=(const TexturePipeline&) = delete;
+
+    // decodes an image file into a new GL_TEXTURE_2D
+    unsigned int load2D(const std::string& path, const TextureOptions& options = TextureOptions())
+    {
+        return request(GL_TEXTURE_2D, {path}, options);
+    }
+
+    // decodes an already read (or mapped) image file into a new GL_TEXTURE_2D; path is only used
+    // for error messages
+    unsigned int load2D(
+        const std::string& path, std::shared_ptr<const MappedFile> encoded,
+        const TextureOptions& options = TextureOptions())
+    {
+        return request(GL_TEXTURE_2D, {path}, options, std::move(encoded));
+    }
+
+    // decodes six faces (+X, -X, +Y, -Y, +Z, -Z) into a new GL_TEXTURE_CUBE_MAP
+    unsigned int loadCubemap(
+        const std::vector<std::string>& faces, const TextureOptions& options = TextureOptions())
+    {
+        return request(GL_TEXTURE_CUBE_MAP, faces, options);
+    }
+
+    // uploads decoded images until none are ready or budgetMs has passed. At least one image is
+    // uploaded per call when available. Returns true once every requested texture is uploaded.
+    bool drainUploads(double budgetMs)
+    {
+        RG_PROFILE_ZONE("Texture uploads");
+        auto start = Clock::now();
+        for (;;)
+        {
+            std::shared_ptr<Job> job;
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                pumpLocked();
+                if (m_Ready.empty())
+                    break;
+                job = std::move(m_Ready.front());
+                m_Ready.pop_front();
+            }
+            // cancel() is only called from this thread, so the flag can't change under us
+            if (!job->cancelled)
+            {
+                auto uploadStart = Clock::now();
+                upload(*job);
+                m_Stats.uploadMs += millisecondsSince(uploadStart);
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                --m_InFlight;
+                --m_Outstanding;
+                pumpLocked();
+            }
+            if (millisecondsSince(start) >= budgetMs)
+                break;
+        }
+        bool done = idle();
+        if (done && !m_Reported && m_Stats.requested > 0)
+        {
+            m_Reported = true;
+            Stats s = stats();
+            std::cout << "TEXTURES:: " << s.uploaded << " textures, decode " << s.decodeMs
+                      << " ms (worker time), upload " << s.uploadMs << " ms" << std::endl;
+            std::cout << "TEXTURES:: " << s.compressedCacheHits << " compressed from cache, "
+                      << s.compressedCooked << " cooked, " << s.uploadedBytes / 1024
+                      << " KiB in VRAM (" << s.uncompressedBytes / 1024 << " KiB uncompressed)"
+                      << std::endl;
+        }
+        return done;
+    }
+
+    // blocks until every requested texture is uploaded
+    void finish()
+    {
+        while (!drainUploads(1e9))
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_ReadyCondition.wait(lock, [this] { return !m_Ready.empty() || m_Outstanding == 0; });
+        }
+    }
+
+    // drops the upload of a texture that is about to be deleted while it is still in flight
+    void cancel(unsigned int id)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (auto it = m_Pending.begin(); it != m_Pending.end(); ++it)
+        {
+            if ((*it)->id == id)
+            {
+                m_Pending.erase(it);
+                --m_Outstanding;
+                return;
+            }
+        }
+        // the job is flagged rather than matched by id later, since GL may hand the same name
+        // out again once the caller deletes the texture
+        for (const std::shared_ptr<Job>& job : m_Ready)
+            if (job->id == id)
+                job->cancelled = true;
+        for (const std::shared_ptr<Job>& job : m_Decoding)
+            if (job->id == id)
+                job->cancelled = true;
+    }
+
+    bool idle() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_Outstanding == 0;
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        Stats s = m_Stats;
+        s.decodeMs = m_DecodeMs;
+        s.compressedCacheHits = m_CompressedCacheHits;
+        s.compressedCooked = m_CompressedCooked;
+        return s;
+    }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Image
+    {
+        unsigned char* pixels = nullptr;
+        int width = 0, height = 0, components = 0;
+    };
+
+    struct Job
+    {
+        GLenum target;
+        unsigned int id;
+        std::vector<std::string> paths;
+        std::shared_ptr<const MappedFile> encoded;
+        TextureOptions options;
+        std::vector<Image> images;
+        CompressedImage compressed;
+        bool cancelled = false;
+
+        Job() = default;
+        Job(const Job&) = delete;
+        Job& operator=(const Job&) = delete;
+        ~Job()
+        {
+            for (Image& image : images)
+                stbi_image_free(image.pixels);
+        }
+    };
+
+    ThreadPool& m_Pool;
+    const unsigned int m_MaxQueued;
+
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_ReadyCondition;
+    std::deque<std::shared_ptr<Job>> m_Pending; // requested, not yet handed to the pool
+    std::deque<std::shared_ptr<Job>> m_Ready;   // decoded, waiting for upload
+    unsigned int m_InFlight = 0;                // decoding or in m_Ready
+    unsigned int m_Outstanding = 0;             // requested and not uploaded yet
+    std::vector<std::shared_ptr<Job>> m_Decoding;
+    double m_DecodeMs = 0.0;
+    unsigned int m_CompressedCacheHits = 0;
+    unsigned int m_CompressedCooked = 0;
+    Stats m_Stats;
+    bool m_Reported = false;
+    bool m_HasS3TC = false;
+
+    static double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    unsigned int request(
+        GLenum target, const std::vector<std::string>& paths, const TextureOptions& options,
+        std::shared_ptr<const MappedFile> encoded = nullptr)
+    {
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->target = target;
+        job->paths = paths;
+        job->encoded = std::move(encoded);
+        job->options = options;
+        if (target != GL_TEXTURE_2D ||
+            (options.compression == TextureCompression::Color && !m_HasS3TC))
+            job->options.compression = TextureCompression::None;
+        glGenTextures(1, &job->id);
+        unsigned int id = job->id;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        ++m_Stats.requested;
+        ++m_Outstanding;
+        m_Pending.push_back(std::move(job));
+        pumpLocked();
+        return id;
+    }
+
+    // hands pending jobs to the pool while the decoded-image budget allows. Workers never block
+    // on a full queue, so the pool stays free for other tasks such as model imports.
+    void pumpLocked()
+    {
+        while (!m_Pending.empty() && m_InFlight < m_MaxQueued)
+        {
+            std::shared_ptr<Job> job = std::move(m_Pending.front());
+            m_Pending.pop_front();
+            ++m_InFlight;
+            m_Decoding.push_back(job);
+            m_Pool.submit([this, job] { decode(job); });
+        }
+    }
+
+    void decode(std::shared_ptr<Job> job)
+    {
+        RG_PROFILE_ZONE("Texture decode");
+        auto start = Clock::now();
+        if (job->options.compression != TextureCompression::None)
+            cook(*job);
+        else
+            decodeImages(*job);
+        job->encoded.reset();
+        double elapsed = millisecondsSince(start);
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_DecodeMs += elapsed;
+        m_Decoding.erase(std::find(m_Decoding.begin(), m_Decoding.end(), job));
+        m_Ready.push_back(std::move(job));
+        m_ReadyCondition.notify_all();
+    }
+
+    void decodeImages(Job& job)
+    {
+        job.images.resize(job.paths.size());
+        for (size_t i = 0; i < job.paths.size(); ++i)
+        {
+            Image& image = job.images[i];
+            if (job.encoded)
+                image.pixels = stbi_load_from_memory(
+                    job.encoded->data(), job.encoded->size(), &image.width, &image.height,
+                    &image.components, 0);
+            else
+                image.pixels = stbi_load(
+                    job.paths[i].c_str(), &image.width, &image.height, &image.components, 0);
+            if (image.pixels && job.options.flip)
+                flipRows(image);
+        }
+    }
+
+    // loads the block compressed version of the image from the cache, or builds and caches it.
+    // On failure job.compressed stays empty and upload() reports the error.
+    void cook(Job& job)
+    {
+        const std::string& path = job.paths[0];
+        std::shared_ptr<const MappedFile> source = job.encoded;
+        if (!source)
+            source = std::make_shared<MappedFile>(path);
+        if (!source->isOpen())
+            return;
+
+        uint64_t sourceHash = fnv1a64(source->data(), source->size());
+        uint32_t flags = (job.options.flip ? 1u : 0u) | ((uint32_t)job.options.compression << 1);
+        if (CompressedTextureCache::Load(path, sourceHash, flags, job.compressed))
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            ++m_CompressedCacheHits;
+            return;
+        }
+
+        Image image;
+        image.pixels = stbi_load_from_memory(
+            source->data(), source->size(), &image.width, &image.height, &image.components, 4);
+        if (!image.pixels)
+            return;
+        int components = image.components;
+        image.components = 4;
+        if (job.options.flip)
+            flipRows(image);
+
+        CompressedImage& compressed = job.compressed;
+        if (job.options.compression == TextureCompression::NormalMap)
+            compressed.format = bc::Format::BC5;
+        else
+            compressed.format =
+                components == 4 && hasTranslucentTexels(image) ? bc::Format::BC3 : bc::Format::BC1;
+
+        // full mip chain down to 1x1, each level encoded across the pool
+        std::vector<uint8_t> level(
+            image.pixels, image.pixels + (size_t)image.width * image.height * 4);
+        stbi_image_free(image.pixels);
+        int width = image.width, height = image.height;
+        for (;;)
+        {
+            CompressedImage::Level out;
+            out.width = width;
+            out.height = height;
+            out.data = bc::compress(compressed.format, level.data(), width, height, &m_Pool);
+            compressed.levels.push_back(std::move(out));
+            if (width == 1 && height == 1)
+                break;
+            level = bc::downsample(level.data(), width, height);
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        CompressedTextureCache::Store(path, sourceHash, flags, compressed);
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        ++m_CompressedCooked;
+    }
+
+    static bool hasTranslucentTexels(const Image& image)
+    {
+        size_t texels = (size_t)image.width * image.height;
+        for (size_t i = 0; i < texels; ++i)
+            if (image.pixels[i * 4 + 3] != 255)
+                return true;
+        return false;
+    }
+
+    static GLenum glFormatFor(bc::Format format)
+    {
+        switch (format)
+        {
+        case bc::Format::BC1:
+            return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case bc::Format::BC3:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case bc::Format::BC5:
+            return GL_COMPRESSED_RG_RGTC2;
+        }
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+
+    void uploadCompressed(Job& job)
+    {
+        const CompressedImage& image = job.compressed;
+        if (image.levels.empty())
+        {
+            std::cout << "Texture failed to load at path: " << job.paths[0] << std::endl;
+            ++m_Stats.failed;
+            return;
+        }
+        GLState::Instance().bindTexture(GL_TEXTURE_2D, job.id);
+        GLenum format = glFormatFor(image.format);
+        for (size_t level = 0; level < image.levels.size(); ++level)
+        {
+            const CompressedImage::Level& data = image.levels[level];
+            glCompressedTexImage2D(
+                GL_TEXTURE_2D, level, format, data.width, data.height, 0, data.data.size(),
+                data.data.data());
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels.size() - 1);
+        bool hasAlpha = image.format == bc::Format::BC3;
+        bool clamp = job.options.clamp || (job.options.clampAlpha && hasAlpha);
+        GLint wrap = clamp ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        const CompressedImage::Level& base = image.levels[0];
+        m_Stats.uploadedBytes += image.byteSize();
+        m_Stats.uncompressedBytes += (size_t)base.width * base.height * (hasAlpha ? 4 : 3) * 4 / 3;
+        ++m_Stats.uploaded;
+    }
+
+    static void flipRows(Image& image)
+    {
+        size_t stride = (size_t)image.width * image.components;
+        std::vector<unsigned char> row(stride);
+        for (int y = 0; y < image.height / 2; ++y)
+        {
+            unsigned char* top = image.pixels + y * stride;
+            unsigned char* bottom = image.pixels + (image.height - 1 - y) * stride;
+            std::memcpy(row.data(), top, stride);
+            std::memcpy(top, bottom, stride);
+            std::memcpy(bottom, row.data(), stride);
+        }
+    }
+
+    static GLenum formatFor(int components)
+    {
+        if (components == 1)
+            return GL_RED;
+        if (components == 4)
+            return GL_RGBA;
+        return GL_RGB;
+    }
+
+    void upload(Job& job)
+    {
+        if (job.options.compression != TextureCompression::None)
+        {
+            uploadCompressed(job);
+            return;
+        }
+        GLState::Instance().bindTexture(job.target, job.id);
+        GLenum format = GL_RGB;
+        bool ok = true;
+        for (size_t i = 0; i < job.images.size(); ++i)
+        {
+            const Image& image = job.images[i];
+            if (!image.pixels)
+            {
+                std::cout << "Texture failed to load at path: " << job.paths[i] << std::endl;
+                ok = false;
+                continue;
+            }
+            format = formatFor(image.components);
+            GLenum target = job.target == GL_TEXTURE_CUBE_MAP
+                                ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum)i
+                                : job.target;
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(
+                target, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE,
+                image.pixels);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            size_t bytes = (size_t)image.width * image.height * image.components;
+            if (job.options.mipmaps)
+                bytes = bytes * 4 / 3;
+            m_Stats.uploadedBytes += bytes;
+            m_Stats.uncompressedBytes += bytes;
+        }
+        if (job.options.mipmaps)
+            glGenerateMipmap(job.target);
+
+        GLint wrap = job.options.clamp || (job.options.clampAlpha && format == GL_RGBA)
+                         ? GL_CLAMP_TO_EDGE
+                         : GL_REPEAT;
+        glTexParameteri(job.target, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(job.target, GL_TEXTURE_WRAP_T, wrap);
+        if (job.target == GL_TEXTURE_CUBE_MAP)
+            glTexParameteri(job.target, GL_TEXTURE_WRAP_R, wrap);
+        glTexParameteri(
+            job.target, GL_TEXTURE_MIN_FILTER,
+            job.options.mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(job.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        if (ok)
+            ++m_Stats.uploaded;
+        else
+            ++m_Stats.failed;
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_TEXTUREPIPELINE_H
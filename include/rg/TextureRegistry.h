@@ -0,0 +1,184 @@
+#ifndef PROJECT_BASE_TEXTUREREGISTRY_H
+#define PROJECT_BASE_TEXTUREREGISTRY_H
+
+#include <glad/glad.h>
+
+#include <rg/Hash.h>
+#include <rg/MappedFile.h>
+#include <rg/TexturePipeline.h>
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rg
+{
+
+// Process-wide, reference counted set of loaded textures. A texture is looked up by its
+// canonical path first and by the file contents second, so the same image referenced from
+// several models (or copied under another name) is decoded and uploaded once. Contents are only
+// read when a loaded file has the same size and decode options, and compared byte for byte, so
+// unique images are never read on this thread. The GL texture is deleted when its last user
+// releases it.
+//
+// Only used from the thread that owns the GL context.
+class TextureRegistry
+{
+  public:
+    struct Stats
+    {
+        unsigned int textures = 0;    // live GL textures owned by the registry
+        unsigned int pathHits = 0;    // acquires resolved by canonical path
+        unsigned int contentHits = 0; // acquires resolved by identical file contents
+    };
+
+    static TextureRegistry& Instance()
+    {
+        static TextureRegistry instance;
+        return instance;
+    }
+
+    // returns the texture for the image at path, loading it through the pipeline if needed.
+    // Every call has to be paired with a release().
+    unsigned int acquire(
+        const std::string& path, const TextureOptions& options, TexturePipeline& pipeline)
+    {
+        // decode options change the uploaded pixels, so they are part of both keys
+        uint64_t optionBits = (options.flip ? 1u : 0u) | (options.mipmaps ? 2u : 0u) |
+                              (options.clampAlpha ? 4u : 0u) | (options.clamp ? 8u : 0u) |
+                              ((uint64_t)options.compression << 4);
+        std::string pathKey = canonicalPath(path) + '#' + std::to_string(optionBits);
+
+        auto byPath = m_ByPath.find(pathKey);
+        if (byPath != m_ByPath.end())
+        {
+            ++m_Stats.pathHits;
+            return addRef(byPath->second);
+        }
+
+        std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(path);
+        uint64_t contentKey = 0;
+        if (file->isOpen())
+        {
+            uint64_t size = file->size();
+            contentKey = fnv1a64(&optionBits, sizeof(optionBits), fnv1a64(&size, sizeof(size)));
+            auto range = m_ByContent.equal_range(contentKey);
+            for (auto byContent = range.first; byContent != range.second; ++byContent)
+            {
+                Entry& candidate = m_Entries[byContent->second];
+                if (candidate.optionBits != optionBits || !sameContents(*file, candidate.source))
+                    continue;
+                ++m_Stats.contentHits;
+                m_ByPath[pathKey] = byContent->second;
+                candidate.paths.push_back(pathKey);
+                return addRef(byContent->second);
+            }
+        }
+
+        // unreadable files still get a (black) texture, the pipeline reports the error
+        unsigned int id = file->isOpen() ? pipeline.load2D(path, file, options)
+                                         : pipeline.load2D(path, options);
+        Entry& entry = m_Entries[id];
+        entry.refCount = 1;
+        entry.contentKey = contentKey;
+        entry.optionBits = optionBits;
+        entry.source = path;
+        entry.pipeline = &pipeline;
+        entry.paths.push_back(pathKey);
+        m_ByPath[pathKey] = id;
+        if (file->isOpen())
+            m_ByContent.emplace(contentKey, id);
+        ++m_Stats.textures;
+        return id;
+    }
+
+    void release(unsigned int id)
+    {
+        auto it = m_Entries.find(id);
+        if (it == m_Entries.end() || --it->second.refCount > 0)
+            return;
+
+        Entry& entry = it->second;
+        for (const std::string& pathKey : entry.paths)
+            m_ByPath.erase(pathKey);
+        auto range = m_ByContent.equal_range(entry.contentKey);
+        for (auto byContent = range.first; byContent != range.second; ++byContent)
+            if (byContent->second == id)
+            {
+                m_ByContent.erase(byContent);
+                break;
+            }
+        entry.pipeline->cancel(id);
+        glDeleteTextures(1, &id);
+        GLState::Instance().textureDeleted(id);
+        m_Entries.erase(it);
+        --m_Stats.textures;
+    }
+
+    // deletes every texture regardless of its users, for shutdown before the GL context goes
+    // away. Later release() calls for these textures are ignored.
+    void clear()
+    {
+        for (auto& entry : m_Entries)
+        {
+            unsigned int id = entry.first;
+            entry.second.pipeline->cancel(id);
+            glDeleteTextures(1, &id);
+            GLState::Instance().textureDeleted(id);
+        }
+        m_Entries.clear();
+        m_ByPath.clear();
+        m_ByContent.clear();
+        m_Stats.textures = 0;
+    }
+
+    const Stats& stats() const { return m_Stats; }
+
+  private:
+    struct Entry
+    {
+        unsigned int refCount = 0;
+        // file size and decode options; equal keys are only candidates
+        uint64_t contentKey = 0;
+        uint64_t optionBits = 0;
+        // the file the texture was loaded from, to compare candidates with
+        std::string source;
+        TexturePipeline* pipeline = nullptr;
+        std::vector<std::string> paths;
+    };
+
+    std::unordered_map<unsigned int, Entry> m_Entries;
+    std::unordered_map<std::string, unsigned int> m_ByPath;
+    std::unordered_multimap<uint64_t, unsigned int> m_ByContent;
+    Stats m_Stats;
+
+    TextureRegistry() = default;
+
+    unsigned int addRef(unsigned int id)
+    {
+        ++m_Entries[id].refCount;
+        return id;
+    }
+
+    static bool sameContents(const MappedFile& file, const std::string& otherPath)
+    {
+        MappedFile other(otherPath);
+        return other.isOpen() && other.size() == file.size() &&
+               std::memcmp(other.data(), file.data(), file.size()) == 0;
+    }
+
+    static std::string canonicalPath(const std::string& path)
+    {
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved))
+            return resolved;
+        return path;
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_TEXTUREREGISTRY_H
@@ -0,0 +1,134 @@
+#ifndef PROJECT_BASE_THREADPOOL_H
+#define PROJECT_BASE_THREADPOOL_H
+
+#include <rg/Profiler.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rg
+{
+
+// Fixed-size pool of worker threads for CPU-side work (asset import, decoding). Tasks must not
+// touch the OpenGL context: results are handed back to the thread that owns it.
+class ThreadPool
+{
+  public:
+    explicit ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency())
+    {
+        threadCount = std::max(threadCount, 1u);
+        for (unsigned int i = 0; i < threadCount; ++i)
+            m_Workers.emplace_back(
+                [this]
+                {
+                    Profiler::Instance().setThreadName("worker");
+                    workerLoop();
+                });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stopping = true;
+        }
+        m_Condition.notify_all();
+        for (std::thread& worker : m_Workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int size() const { return m_Workers.size(); }
+
+    template <typename F> auto submit(F&& f) -> std::future<decltype(f())>
+    {
+        using Result = decltype(f());
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Tasks.emplace_back([task] { (*task)(); });
+        }
+        m_Condition.notify_one();
+        return result;
+    }
+
+    // runs fn(i) for every i in [0, count) and returns once all calls finished. The calling thread
+    // takes part, so this is safe to call from inside a pool task.
+    template <typename F> void parallelFor(size_t count, F fn)
+    {
+        if (count == 0)
+            return;
+        struct Shared
+        {
+            std::atomic<size_t> next{0};
+            size_t done = 0;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto shared = std::make_shared<Shared>();
+        size_t total = count;
+        auto work = [shared, total, fn]
+        {
+            size_t completed = 0;
+            for (size_t i = shared->next++; i < total; i = shared->next++)
+            {
+                fn(i);
+                ++completed;
+            }
+            if (completed == 0)
+                return;
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->done += completed;
+            if (shared->done == total)
+                shared->finished.notify_all();
+        };
+
+        size_t helpers = std::min<size_t>(count - 1, m_Workers.size());
+        for (size_t i = 0; i < helpers; ++i)
+            submit(work);
+        work();
+
+        // helpers that start after every index was claimed return immediately, so only the
+        // indices themselves have to be accounted for
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->finished.wait(lock, [&] { return shared->done == total; });
+    }
+
+  private:
+    std::vector<std::thread> m_Workers;
+    std::deque<std::function<void()>> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    bool m_Stopping = false;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Condition.wait(lock, [this] { return m_Stopping || !m_Tasks.empty(); });
+                if (m_Stopping && m_Tasks.empty())
+                    return;
+                task = std::move(m_Tasks.front());
+                m_Tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_THREADPOOL_H
@@ -0,0 +1,151 @@
+#ifndef PROJECT_BASE_UNIFORMBLOCKS_H
+#define PROJECT_BASE_UNIFORMBLOCKS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <iostream>
+
+namespace rg
+{
+
+// C++ mirrors of the std140 uniform blocks shared by the shaders. The GLSL declarations are
+// repeated in every shader that reads a block and must stay in sync with the structs below; the
+// offsets in the comments are the std140 ones and are checked by the static_asserts.
+
+const GLuint FRAME_DATA_BINDING = 0;
+const GLuint LIGHT_DATA_BINDING = 1;
+
+// layout (std140) uniform FrameData
+struct FrameData
+{
+    glm::mat4 projection;   // 0
+    glm::mat4 view;         // 64
+    glm::vec3 viewPosition; // 128
+    float time;             // 140
+};
+static_assert(offsetof(FrameData, projection) == 0, "FrameData does not match std140");
+static_assert(offsetof(FrameData, view) == 64, "FrameData does not match std140");
+static_assert(offsetof(FrameData, viewPosition) == 128, "FrameData does not match std140");
+static_assert(offsetof(FrameData, time) == 140, "FrameData does not match std140");
+static_assert(sizeof(FrameData) == 144, "FrameData does not match std140");
+
+// struct PointLight, scalars fill the padding after each vec3
+struct PointLightData
+{
+    glm::vec3 position; // 0
+    float constant;     // 12
+    glm::vec3 ambient;  // 16
+    float linear;       // 28
+    glm::vec3 diffuse;  // 32
+    float quadratic;    // 44
+    glm::vec3 specular; // 48
+    float padding;      // structs are rounded up to 16 bytes
+};
+static_assert(offsetof(PointLightData, constant) == 12, "PointLightData does not match std140");
+static_assert(offsetof(PointLightData, ambient) == 16, "PointLightData does not match std140");
+static_assert(offsetof(PointLightData, linear) == 28, "PointLightData does not match std140");
+static_assert(offsetof(PointLightData, diffuse) == 32, "PointLightData does not match std140");
+static_assert(offsetof(PointLightData, quadratic) == 44, "PointLightData does not match std140");
+static_assert(offsetof(PointLightData, specular) == 48, "PointLightData does not match std140");
+static_assert(sizeof(PointLightData) == 64, "PointLightData does not match std140");
+
+// struct DirLight
+struct DirLightData
+{
+    glm::vec3 direction; // 0
+    float padding0;
+    glm::vec3 ambient; // 16
+    float padding1;
+    glm::vec3 diffuse; // 32
+    float padding2;
+    glm::vec3 specular; // 48
+    float padding3;
+};
+static_assert(offsetof(DirLightData, ambient) == 16, "DirLightData does not match std140");
+static_assert(offsetof(DirLightData, diffuse) == 32, "DirLightData does not match std140");
+static_assert(offsetof(DirLightData, specular) == 48, "DirLightData does not match std140");
+static_assert(sizeof(DirLightData) == 64, "DirLightData does not match std140");
+
+// layout (std140) uniform LightData
+struct LightData
+{
+    PointLightData pointLight; // 0
+    DirLightData dirLight;     // 64
+    int blinn;                 // 128, GLSL bool
+    int padding[3];
+};
+static_assert(offsetof(LightData, dirLight) == 64, "LightData does not match std140");
+static_assert(offsetof(LightData, blinn) == 128, "LightData does not match std140");
+static_assert(sizeof(LightData) == 144, "LightData does not match std140");
+
+// Binds the blocks a program declares to their binding points. The size the compiler gave each
+// block is compared with its mirror, which catches a GLSL declaration that drifted from the
+// struct. Block bindings are program state, so this runs after every link or binary load.
+inline void bindUniformBlocks(unsigned int program)
+{
+    struct Block
+    {
+        const char* name;
+        GLuint binding;
+        size_t size;
+    };
+    const Block blocks[] = {
+        {"FrameData", FRAME_DATA_BINDING, sizeof(FrameData)},
+        {"LightData", LIGHT_DATA_BINDING, sizeof(LightData)},
+    };
+    for (const Block& block : blocks)
+    {
+        GLuint index = glGetUniformBlockIndex(program, block.name);
+        if (index == GL_INVALID_INDEX)
+            continue;
+        GLint size = 0;
+        glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        if ((size_t)size != block.size)
+            std::cout << "ERROR::UNIFORM_BLOCK::SIZE_MISMATCH " << block.name << ": " << size
+                      << " bytes in GLSL, " << block.size << " in C++" << std::endl;
+        glUniformBlockBinding(program, index, block.binding);
+    }
+}
+
+// Buffer behind one uniform block, bound to its binding point for good. update() replaces the
+// whole contents; the old storage is orphaned first so a buffer still read by the previous
+// frame doesn't stall the upload.
+template <typename T> class UniformBuffer
+{
+  public:
+    UniformBuffer() = default;
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    void create(GLuint binding)
+    {
+        glGenBuffers(1, &m_Buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, m_Buffer);
+    }
+
+    void update(const T& data)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void destroy()
+    {
+        if (m_Buffer)
+            glDeleteBuffers(1, &m_Buffer);
+        m_Buffer = 0;
+    }
+
+  private:
+    unsigned int m_Buffer = 0;
+};
+
+}; // namespace rg
+#endif // PROJECT_BASE_UNIFORMBLOCKS_H
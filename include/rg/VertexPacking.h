@@ -0,0 +1,173 @@
+#ifndef PROJECT_BASE_VERTEXPACKING_H
+#define PROJECT_BASE_VERTEXPACKING_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace rg
+{
+
+// 20 byte vertex used by VertexFormat::Packed (the float Vertex is 56 bytes):
+//   position  - 3 x unorm16 relative to the mesh bounds, w holds the bitangent sign (0 = -1)
+//   normal    - octahedral encoded, 2 x snorm16
+//   tangent   - octahedral encoded, 2 x snorm16; bitangent = cross(normal, tangent) * sign
+//   texCoords - 2 x half float
+// Decoded in 2.model_lighting_packed.vs.
+struct PackedVertex
+{
+    uint16_t position[4];
+    int16_t normal[2];
+    int16_t tangent[2];
+    uint16_t texCoords[2];
+};
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must stay 20 bytes");
+
+// largest decode error over a set of vertices: object space units, degrees, texture coordinates
+struct PackingError
+{
+    float position = 0.0f;
+    float normalDegrees = 0.0f;
+    float tangentDegrees = 0.0f;
+    float texCoord = 0.0f;
+
+    void merge(const PackingError& other)
+    {
+        position = std::max(position, other.position);
+        normalDegrees = std::max(normalDegrees, other.normalDegrees);
+        tangentDegrees = std::max(tangentDegrees, other.tangentDegrees);
+        texCoord = std::max(texCoord, other.texCoord);
+    }
+};
+
+struct PackedVertices
+{
+    std::vector<PackedVertex> vertices;
+    // object space position = positionOffset + position.xyz / 65535 * positionScale, i.e. the
+    // normalized attribute times the extent of the mesh bounds
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    PackingError error;
+};
+
+namespace packing
+{
+
+inline float signNotZero(float v) { return v >= 0.0f ? 1.0f : -1.0f; }
+
+inline int16_t toSnorm16(float v)
+{
+    return (int16_t)std::lround(std::min(std::max(v, -1.0f), 1.0f) * 32767.0f);
+}
+
+inline float fromSnorm16(int16_t v) { return std::max(v / 32767.0f, -1.0f); }
+
+// falls back to the given axis for degenerate input (e.g. tangents of meshes without UVs)
+inline glm::vec3 safeNormalize(const glm::vec3& v, const glm::vec3& fallback)
+{
+    float length = glm::length(v);
+    if (!(length > 1e-12f) || !std::isfinite(length))
+        return fallback;
+    return v / length;
+}
+
+inline void octEncode(const glm::vec3& n, int16_t out[2])
+{
+    float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    float x = n.x / l1, y = n.y / l1;
+    if (n.z < 0.0f)
+    {
+        float ox = (1.0f - std::fabs(y)) * signNotZero(x);
+        float oy = (1.0f - std::fabs(x)) * signNotZero(y);
+        x = ox;
+        y = oy;
+    }
+    out[0] = toSnorm16(x);
+    out[1] = toSnorm16(y);
+}
+
+inline glm::vec3 octDecode(const int16_t in[2])
+{
+    glm::vec3 v(fromSnorm16(in[0]), fromSnorm16(in[1]), 0.0f);
+    v.z = 1.0f - std::fabs(v.x) - std::fabs(v.y);
+    if (v.z < 0.0f)
+    {
+        float x = (1.0f - std::fabs(v.y)) * signNotZero(v.x);
+        float y = (1.0f - std::fabs(v.x)) * signNotZero(v.y);
+        v.x = x;
+        v.y = y;
+    }
+    return glm::normalize(v);
+}
+
+inline float angleDegrees(const glm::vec3& a, const glm::vec3& b)
+{
+    return glm::degrees(std::acos(std::min(std::max(glm::dot(a, b), -1.0f), 1.0f)));
+}
+
+}; // namespace packing
+
+// packs any vertex type with Position/Normal/TexCoords/Tangent/Bitangent members (Vertex) and
+// measures the round trip error
+template <typename VertexT> PackedVertices packVertices(const std::vector<VertexT>& vertices)
+{
+    using namespace packing;
+    PackedVertices result;
+    PackingError& error = result.error;
+    if (vertices.empty())
+        return result;
+
+    glm::vec3 lo = vertices[0].Position, hi = vertices[0].Position;
+    for (const VertexT& vertex : vertices)
+    {
+        lo = glm::min(lo, vertex.Position);
+        hi = glm::max(hi, vertex.Position);
+    }
+    result.positionOffset = lo;
+    // flat axes get a non-zero scale so decoding stays well defined
+    result.positionScale = glm::max(hi - lo, glm::vec3(1e-6f));
+
+    result.vertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        const VertexT& in = vertices[i];
+        PackedVertex& out = result.vertices[i];
+
+        glm::vec3 normal = safeNormalize(in.Normal, glm::vec3(0.0f, 0.0f, 1.0f));
+        glm::vec3 tangent = safeNormalize(in.Tangent, glm::vec3(1.0f, 0.0f, 0.0f));
+        bool mirrored = glm::dot(glm::cross(normal, tangent), in.Bitangent) < 0.0f;
+
+        glm::vec3 normalized = (in.Position - lo) / result.positionScale;
+        for (int c = 0; c < 3; ++c)
+            out.position[c] = (uint16_t)std::lround(
+                std::min(std::max(normalized[c], 0.0f), 1.0f) * 65535.0f);
+        out.position[3] = mirrored ? 0 : 65535;
+        octEncode(normal, out.normal);
+        octEncode(tangent, out.tangent);
+        out.texCoords[0] = glm::packHalf1x16(in.TexCoords.x);
+        out.texCoords[1] = glm::packHalf1x16(in.TexCoords.y);
+
+        // round trip, the same math as the vertex shader
+        glm::vec3 position(out.position[0], out.position[1], out.position[2]);
+        position = result.positionOffset + position / 65535.0f * result.positionScale;
+        glm::vec3 positionError = glm::abs(position - in.Position);
+        error.position = std::max(
+            error.position, std::max(positionError.x, std::max(positionError.y, positionError.z)));
+        error.normalDegrees =
+            std::max(error.normalDegrees, angleDegrees(octDecode(out.normal), normal));
+        error.tangentDegrees =
+            std::max(error.tangentDegrees, angleDegrees(octDecode(out.tangent), tangent));
+        glm::vec2 texCoords(
+            glm::unpackHalf1x16(out.texCoords[0]), glm::unpackHalf1x16(out.texCoords[1]));
+        glm::vec2 texCoordError = glm::abs(texCoords - in.TexCoords);
+        error.texCoord = std::max(error.texCoord, std::max(texCoordError.x, texCoordError.y));
+    }
+    return result;
+}
+
+}; // namespace rg
+#endif // PROJECT_BASE_VERTEXPACKING_H
@@ -2,26 +2,6 @@
 out vec4 FragColor;
 
 
-struct PointLight {
-    vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct DirLight {
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
 struct Material {
     sampler2D texture_diffuse1;
     sampler2D texture_specular1;
@@ -36,13 +16,32 @@ in vec3 TangentViewPos;
 in vec3 TangentFragPos;
 in vec3 TangentLightPos;
 
-uniform PointLight pointLight;
-uniform DirLight dirLight;
 uniform Material material;
 
-uniform vec3 lightPos;
-uniform bool blinn;
-uniform vec3 viewPosition;
+// keep the block in sync with rg/UniformBlocks.h
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+};
+
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout (std140) uniform LightData
+{
+    PointLight pointLight;
+    DirLight dirLight;
+    bool blinn;
+};
 // calculates the color when using a point light.
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
@@ -103,8 +102,9 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 
 void main()
 {
-    vec3 normal = texture(material.texture_normal1,TexCoords).rgb;
-    normal = normalize(normal * 2.0 - 1.0);
+    // normal maps may be BC5 compressed (only X/Y stored), so Z is always rebuilt
+    vec2 normalXY = texture(material.texture_normal1,TexCoords).rg * 2.0 - 1.0;
+    vec3 normal = normalize(vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0))));
     vec3 viewDir = normalize(TangentViewPos - TangentFragPos);
     vec3 result = CalcDirLight(dirLight,normal,viewDir);
     result += CalcPointLight(pointLight, normal, TangentFragPos, viewDir);
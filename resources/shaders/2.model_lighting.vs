@@ -14,25 +14,63 @@ out vec3 TangentViewPos;
 out vec3 TangentFragPos;
 out vec3 TangentLightPos;
 
+#ifdef INSTANCED
+layout (location = 5) in mat4 aInstanceModel; // rg::InstanceBuffer::MATRIX_LOCATION
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
 
-uniform vec3 lightPos;
-uniform vec3 viewPosition;
+// keep the blocks in sync with rg/UniformBlocks.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+    float time;
+};
+
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+};
+
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout (std140) uniform LightData
+{
+    PointLight pointLight;
+    DirLight dirLight;
+    bool blinn;
+};
 
 void main()
 {
+#ifdef INSTANCED
+    mat4 model = aInstanceModel;
+#endif
     FragPos = vec3(model * vec4(aPos, 1.0));
     mat3 normalMatrix = transpose(inverse(mat3(model)));
     TexCoords = aTexCoords;
     vec3 T = normalize(normalMatrix * aTangent);
     vec3 N = normalize(normalMatrix * aNormal);
     T = normalize(T - dot(T,N) * N);
-    vec3 B = cross(N,T);
+    // the same handedness as the packed layout keeps in the sign bit (rg/VertexPacking.h), so
+    // mirrored UVs light the same in both
+    float bitangentSign = dot(cross(aNormal, aTangent), aBitangent) < 0.0 ? -1.0 : 1.0;
+    vec3 B = cross(N,T) * bitangentSign;
 
     mat3 TBN = transpose(mat3(T,B,N));
-    TangentLightPos = TBN * lightPos;
+    TangentLightPos = TBN * pointLight.position;
     TangentViewPos = TBN * viewPosition;
     TangentFragPos = TBN * FragPos;
 
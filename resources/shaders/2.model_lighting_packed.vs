@@ -0,0 +1,89 @@
+#version 330 core
+// same as 2.model_lighting.vs, for meshes uploaded with VertexFormat::Packed (rg::PackedVertex)
+layout (location = 0) in vec4 aPos;       // xyz normalized to the mesh bounds, w = bitangent sign
+layout (location = 1) in vec2 aNormal;    // octahedral
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec2 aTangent;   // octahedral
+
+out vec2 TexCoords;
+out vec3 Normal;
+out vec3 FragPos;
+
+out mat3 TBN;
+out vec3 TangentViewPos;
+out vec3 TangentFragPos;
+out vec3 TangentLightPos;
+
+#ifdef INSTANCED
+layout (location = 5) in mat4 aInstanceModel; // rg::InstanceBuffer::MATRIX_LOCATION
+#else
+uniform mat4 model;
+#endif
+
+// keep the blocks in sync with rg/UniformBlocks.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+    float time;
+};
+
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+};
+
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout (std140) uniform LightData
+{
+    PointLight pointLight;
+    DirLight dirLight;
+    bool blinn;
+};
+
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0)
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(v);
+}
+
+void main()
+{
+#ifdef INSTANCED
+    mat4 model = aInstanceModel;
+#endif
+    vec3 position = positionOffset + aPos.xyz * positionScale;
+    float bitangentSign = aPos.w > 0.5 ? 1.0 : -1.0;
+
+    FragPos = vec3(model * vec4(position, 1.0));
+    mat3 normalMatrix = transpose(inverse(mat3(model)));
+    TexCoords = aTexCoords;
+    vec3 T = normalize(normalMatrix * octDecode(aTangent));
+    vec3 N = normalize(normalMatrix * octDecode(aNormal));
+    T = normalize(T - dot(T,N) * N);
+    vec3 B = cross(N,T) * bitangentSign;
+
+    mat3 TBN = transpose(mat3(T,B,N));
+    TangentLightPos = TBN * pointLight.position;
+    TangentViewPos = TBN * viewPosition;
+    TangentFragPos = TBN * FragPos;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
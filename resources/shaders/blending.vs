@@ -4,12 +4,26 @@ layout (location = 1) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
+#ifdef INSTANCED
+layout (location = 5) in mat4 aInstanceModel; // rg::InstanceBuffer::MATRIX_LOCATION
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+
+// keep the blocks in sync with rg/UniformBlocks.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+    float time;
+};
 
 void main()
 {
+#ifdef INSTANCED
+    mat4 model = aInstanceModel;
+#endif
     TexCoords = aTexCoords;
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,8 @@
+#version 330 core
+out vec4 FragColor;
+
+// only the samples that pass the depth test matter, color writes are masked off
+void main()
+{
+    FragColor = vec4(1.0);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// keep the blocks in sync with rg/UniformBlocks.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+    float time;
+};
+
+// world space box the unit cube is stretched over
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+void main()
+{
+    gl_Position = projection * view * vec4(mix(boxMin, boxMax, aPos), 1.0);
+}
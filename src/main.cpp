@@ -13,8 +13,24 @@
 #include <learnopengl/filesystem.h>
 #include <learnopengl/model.h>
 #include <learnopengl/shader.h>
-
+#include <rg/BenchReport.h>
+#include <rg/Bvh.h>
+#include <rg/CameraPath.h>
+#include <rg/GpuTimer.h>
+#include <rg/HeadlessContext.h>
+#include <rg/InputTrace.h>
+#include <rg/OcclusionQueries.h>
+#include <rg/Profiler.h>
+
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <random>
+#include <type_traits>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 
@@ -24,15 +40,29 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 
 void processInput(GLFWwindow* window);
 
+bool keyPressed(GLFWwindow* window, int key);
+
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 
-auto loadCubemap(vector<std::string> faces) -> unsigned int;
+auto loadCubemap(rg::TexturePipeline& textures, vector<std::string> faces) -> unsigned int;
 
-auto loadTexture(const char* path) -> unsigned int;
+auto loadTexture(rg::TexturePipeline& textures, const char* path) -> unsigned int;
 
 // settings
 const unsigned int SCR_WIDTH = 1200;
 const unsigned int SCR_HEIGHT = 800;
+// time per frame the render thread may spend uploading decoded textures
+const double TEXTURE_UPLOAD_BUDGET_MS = 4.0;
+// objects whose bounding radius is at least this fraction of their distance are rendered as
+// occluders for the software occlusion pass
+const float OCCLUDER_MIN_SIZE = 0.2f;
+// vertex layout of the models; Packed is 20 instead of 56 bytes per vertex, at the cost of
+// quantized positions and normals
+const VertexFormat MODEL_VERTEX_FORMAT = VertexFormat::Float;
+// --bench renders this many frames unless --frames says otherwise, advancing the scene by a fixed
+// step per frame so every run renders the same images
+const int BENCH_FRAMES = 600;
+const float BENCH_TIMESTEP = 1.0f / 60.0f;
 
 // camera
 
@@ -44,6 +74,26 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// what the models were drawn with last frame, shown in the ImGui window
+rg::LodStats lodStats;
+rg::RenderQueue::Stats renderStats;
+rg::GLState::Stats glStateStats;
+rg::CullStats cullStats;
+const char* lookingAt = "nothing";
+rg::OcclusionStats occlusionStats;
+rg::OcclusionQueries::Stats queryStats;
+// CPU and GPU time of the sections of a recent frame, and the frames the GPU timer dropped
+rg::GpuTimer::Frame passTimes;
+unsigned int passTimesDropped = 0;
+
+// draw calls and triangles of the whole frame, counted from the stats above
+struct FrameCounts
+{
+    unsigned int drawCalls = 0;
+    unsigned long long triangles = 0;
+};
+FrameCounts frameCounts;
+
 struct PointLight
 {
     glm::vec3 position;
@@ -95,6 +145,20 @@ struct ProgramState
     glm::vec3 karenPosition = glm::vec3(22.5f, -19.5f, 15.0f);
     float karenScale = 0.5f;
 
+    // log2 of the screen space error the model LODs may have, higher is coarser
+    float lodBias = 0.0f;
+
+    // instanced kelp quads around the original five, and copies of patrick next to him
+    int kelpCount = 5;
+    int crowdCount = 0;
+
+    // skip models and meshes outside the view frustum
+    bool frustumCulling = true;
+    // skip models hidden behind large ones, tested on the CPU
+    bool occlusionCulling = true;
+    // draw models whose bounding box was hidden last frame only if it still is not
+    bool gpuOcclusion = false;
+
     // light settings
     bool blinn = false;
     bool blinnKeyPressed = false;
@@ -134,113 +198,324 @@ void ProgramState::LoadFromFile(std::string filename)
 }
 
 ProgramState* programState;
+static_assert(
+    std::is_trivially_copyable<ProgramState>::value, "input traces store ProgramState as bytes");
 
-void DrawImGui(ProgramState* programState);
-
-auto main() -> int
-{
-    // glfw: initialize and configure
+// --record writes the session to a trace; --replay plays one back in place of the window's input
+rg::InputRecorder inputRecorder;
+rg::InputPlayer inputPlayer;
 
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+void DrawImGui(ProgramState* programState);
 
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
+void DrawProfiler();
 
-    // glfw window creation
+void DrawPerformance();
 
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", nullptr, nullptr);
-    if (window == nullptr)
+// model matrices of count kelp quads: the five original ones, then a field scattered around them
+// that grows with the count
+vector<glm::mat4> KelpField(int count)
+{
+    vector<glm::mat4> kelp;
+    kelp.reserve(count);
+    for (int i = 0; i < count && i < 5; i++)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        glm::vec3 position = glm::vec3(18.0f, -12.0f, 25.0f) + 0.1f * glm::vec3(i, -i, i);
+        kelp.push_back(glm::translate(glm::mat4(1.0f), position));
+    }
+    float radius = 0.5f * std::sqrt((float)count);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    while ((int)kelp.size() < count)
+    {
+        glm::vec3 position(18.0f + radius * unit(random), -12.0f, 25.0f + radius * unit(random));
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+        float angle = glm::radians(180.0f * unit(random));
+        kelp.push_back(glm::rotate(model, angle, glm::vec3(0.0f, 1.0f, 0.0f)));
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetKeyCallback(window, key_callback);
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    return kelp;
+}
 
-    // glad: load all OpenGL function pointers
+// points the camera from position at target
+void AimCamera(Camera& camera, const glm::vec3& position, const glm::vec3& target)
+{
+    glm::vec3 direction = glm::normalize(target - position);
+    camera.Position = position;
+    camera.Yaw = glm::degrees(std::atan2(direction.z, direction.x));
+    camera.Pitch = glm::degrees(std::asin(direction.y));
+    // recomputes the camera vectors from the new angles
+    camera.ProcessMouseMovement(0.0f, 0.0f);
+}
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+auto main(int argc, char** argv) -> int
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point startTime = Clock::now();
+    rg::Profiler::Instance().setThreadName("main");
+
+    // --bench [--frames N] [--report path]: render a scripted flythrough offscreen, without a
+    // window, and write the timings as JSON. With --replay the trace is rendered instead.
+    bool bench = false;
+    int benchFrames = -1;
+    std::string benchReportPath = "bench_report.json";
+    std::string recordPath, replayPath;
+    bool usage = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--bench") == 0)
+            bench = true;
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            benchFrames = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+            benchReportPath = argv[++i];
+        else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replayPath = argv[++i];
+        else
+            usage = true;
+    }
+    // a recording is made interactively, and of nothing else
+    if (usage || (!recordPath.empty() && (bench || !replayPath.empty())))
     {
-        std::cout << "Failed to initialize GLAD" << std::endl;
+        std::cout << "usage: " << argv[0] << " [--record trace]\n       " << argv[0]
+                  << " [--bench [--frames N] [--report path]] [--replay trace]" << std::endl;
         return -1;
     }
+    // a replayed trace runs to its end
+    if (benchFrames < 0)
+        benchFrames = replayPath.empty() ? BENCH_FRAMES : std::numeric_limits<int>::max();
+
+    GLFWwindow* window = nullptr;
+    rg::HeadlessContext headless;
+    GLADloadproc loadProc = nullptr;
+    if (bench)
+    {
+        if (!headless.create(SCR_WIDTH, SCR_HEIGHT))
+            return -1;
+        loadProc = rg::HeadlessContext::GetProcAddress();
+    }
+    else
+    {
+        // glfw: initialize and configure
+
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+        // glfw window creation
+
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", nullptr, nullptr);
+        if (window == nullptr)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        // a replay takes its input from the trace only
+        if (replayPath.empty())
+        {
+            glfwSetCursorPosCallback(window, mouse_callback);
+            glfwSetScrollCallback(window, scroll_callback);
+            glfwSetKeyCallback(window, key_callback);
+        }
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // glad: load all OpenGL function pointers
 
-    // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
-    stbi_set_flip_vertically_on_load(true);
+        loadProc = (GLADloadproc)glfwGetProcAddress;
+        if (!gladLoadGLLoader(loadProc))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+    }
+    // linked shader programs are cached on disk when the driver can hand them out
+    rg::ProgramCache::Instance().init(loadProc);
 
     programState = new ProgramState;
-    if (programState->ImGuiEnabled)
+    if (!replayPath.empty())
     {
-        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+        if (!inputPlayer.open(replayPath, sizeof(ProgramState)))
+            return -1;
+        inputPlayer.initialState(programState);
+    }
+    else if (
+        !recordPath.empty() && !inputRecorder.open(recordPath, programState, sizeof(ProgramState)))
+        return -1;
+    if (bench)
+        programState->ImGuiEnabled = false;
+    else
+    {
+        if (programState->ImGuiEnabled)
+        {
+            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+        }
+        // Init Imgui
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO& io = ImGui::GetIO();
+        (void)io;
+
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
+        ImGui_ImplOpenGL3_Init("#version 330 core");
     }
-    // Init Imgui
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO();
-    (void)io;
-
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 330 core");
-
-    // configure global opengl state
 
-    glEnable(GL_DEPTH_TEST);
+    // configure global opengl state; switches, binds and the depth state that change during the
+    // frame go through rg::GLState, which skips the redundant ones
+    rg::GLState& glState = rg::GLState::Instance();
+    glState.enable(GL_DEPTH_TEST);
 
     // blending
-    glEnable(GL_BLEND);
+    glState.enable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // facecull
-    glEnable(GL_CULL_FACE);
+    glState.enable(GL_CULL_FACE);
     glCullFace(GL_FRONT);
     glFrontFace(GL_CW);
 
     // build and compile shaders
     Shader ourShader(
-        "resources/shaders/2.model_lighting.vs", "resources/shaders/2.model_lighting.fs");
+        MODEL_VERTEX_FORMAT == VertexFormat::Packed
+            ? "resources/shaders/2.model_lighting_packed.vs"
+            : "resources/shaders/2.model_lighting.vs",
+        "resources/shaders/2.model_lighting.fs");
     Shader skyboxShader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
-    Shader blendingShader("resources/shaders/blending.vs", "resources/shaders/blending.fs");
+    Shader blendingShader(
+        "resources/shaders/blending.vs", "resources/shaders/blending.fs", nullptr, {"INSTANCED"});
+    Shader instancedShader(
+        MODEL_VERTEX_FORMAT == VertexFormat::Packed
+            ? "resources/shaders/2.model_lighting_packed.vs"
+            : "resources/shaders/2.model_lighting.vs",
+        "resources/shaders/2.model_lighting.fs", nullptr, {"INSTANCED"});
+    Shader occlusionBoxShader(
+        "resources/shaders/occlusion_box.vs", "resources/shaders/occlusion_box.fs");
+    rg::OcclusionQueries occlusionQueries;
+    occlusionQueries.create(occlusionBoxShader);
+    // per frame uniforms, resolved once
+    Shader::Uniform<float> modelShininess = ourShader.uniform<float>("material.shininess");
+    Shader::Uniform<float> crowdShininess = instancedShader.uniform<float>("material.shininess");
+    // the sections of the frame, timed on the GPU without waiting for it
+    rg::GpuTimer gpuTimer;
+    gpuTimer.create();
+    // camera and lights are shared by all shaders through uniform blocks, uploaded once a frame
+    rg::UniformBuffer<rg::FrameData> frameBuffer;
+    rg::UniformBuffer<rg::LightData> lightBuffer;
+    frameBuffer.create(rg::FRAME_DATA_BINDING);
+    lightBuffer.create(rg::LIGHT_DATA_BINDING);
+    // draws are collected every frame and issued sorted by state
+    rg::RenderQueue renderQueue;
+    // objects drawn under conditional rendering, one at a time
+    rg::RenderQueue deferredQueue;
+    const rg::ProgramCache::Stats& programStats = rg::ProgramCache::Instance().stats();
+    std::cout << "SHADER:: program cache " << programStats.hits << " hits, " << programStats.misses
+              << " misses" << std::endl;
+
+    // load models: Assimp import and mesh conversion run on the worker pool, while this thread
+    // only creates the GL objects once each import is done. Textures are decoded on the pool as
+    // well and uploaded a few at a time from the render loop.
+    rg::ThreadPool threadPool;
+    rg::TexturePipeline texturePipeline(threadPool);
+    auto garyData = Model::ImportAsync(threadPool, "resources/objects/gary/gary.obj", true);
+    auto houseData = Model::ImportAsync(threadPool, "resources/objects/house/house.obj", false);
+    auto patrickData =
+        Model::ImportAsync(threadPool, "resources/objects/patrick/patrick.obj", true);
+    auto squidData = Model::ImportAsync(threadPool, "resources/objects/squid/squid.obj", true);
+    auto spongeData = Model::ImportAsync(threadPool, "resources/objects/sponge/sponge.obj", true);
+    /*  auto krustyData =
+            Model::ImportAsync(threadPool, "resources/objects/krusty/krusty.obj", false);
+    */
+    auto krabsData = Model::ImportAsync(threadPool, "resources/objects/krabs/krabs.obj", true);
+    auto karenData =
+        Model::ImportAsync(threadPool, "resources/objects/karen/karenbyanto.obj", true);
 
-    // load models
-    Model ourModel("resources/objects/gary/gary.obj");
+    Model ourModel(garyData.get(), texturePipeline, MODEL_VERTEX_FORMAT);
     ourModel.SetShaderTextureNamePrefix("material.");
 
-    stbi_set_flip_vertically_on_load(false);
-
-    Model house("resources/objects/house/house.obj");
+    Model house(houseData.get(), texturePipeline, MODEL_VERTEX_FORMAT);
     house.SetShaderTextureNamePrefix("material.");
 
-    stbi_set_flip_vertically_on_load(true);
-    Model patrick("resources/objects/patrick/patrick.obj");
+    Model patrick(patrickData.get(), texturePipeline, MODEL_VERTEX_FORMAT);
     patrick.SetShaderTextureNamePrefix("material.");
 
-    Model squid("resources/objects/squid/squid.obj");
+    Model squid(squidData.get(), texturePipeline, MODEL_VERTEX_FORMAT);
     squid.SetShaderTextureNamePrefix("material.");
 
-    Model sponge("resources/objects/sponge/sponge.obj");
+    Model sponge(spongeData.get(), texturePipeline, MODEL_VERTEX_FORMAT);
     sponge.SetShaderTextureNamePrefix("material.");
 
-    /*    stbi_set_flip_vertically_on_load(false);
-        Model krusty("resources/objects/krusty/krusty.obj");
+    /*  Model krusty(krustyData.get(), texturePipeline, MODEL_VERTEX_FORMAT);
         krusty.SetShaderTextureNamePrefix("material.");
-        stbi_set_flip_vertically_on_load(true);
     */
-    Model krabs("resources/objects/krabs/krabs.obj");
+    Model krabs(krabsData.get(), texturePipeline, MODEL_VERTEX_FORMAT);
     krabs.SetShaderTextureNamePrefix("material.");
 
-    Model karen("resources/objects/karen/karenbyanto.obj");
+    Model karen(karenData.get(), texturePipeline, MODEL_VERTEX_FORMAT);
     karen.SetShaderTextureNamePrefix("material.");
 
+    // the models placed through ProgramState. Their world bounds go into the scene BVH in this
+    // order, so its queries answer with indices into scene.
+    struct SceneObject
+    {
+        const char* name;
+        Model* model;
+        bool cullFace; // the sponge is the only model closed enough for back face culling
+        glm::mat4 transform;
+        rg::Occluder occluder;
+    };
+    vector<SceneObject> scene = {
+        {"Gary", &ourModel, false, glm::mat4(1.0f), ourModel.BuildOccluder()},
+        {"House", &house, false, glm::mat4(1.0f), house.BuildOccluder()},
+        {"Patrick", &patrick, false, glm::mat4(1.0f), patrick.BuildOccluder()},
+        {"Squidward", &squid, false, glm::mat4(1.0f), squid.BuildOccluder()},
+        {"SpongeBob", &sponge, true, glm::mat4(1.0f), sponge.BuildOccluder()},
+        {"Mr. Krabs", &krabs, false, glm::mat4(1.0f), krabs.BuildOccluder()},
+        {"Karen", &karen, false, glm::mat4(1.0f), karen.BuildOccluder()}};
+    auto place = [&scene](const Model& model, const glm::mat4& transform)
+    {
+        for (SceneObject& object : scene)
+            if (object.model == &model)
+                object.transform = transform;
+    };
+    vector<rg::Bounds> sceneBounds(scene.size());
+    vector<char> sceneVisible(scene.size());
+    // objects that get a GPU occlusion query this frame, and those of them hidden last frame
+    vector<unsigned int> queriedObjects, deferredObjects;
+    rg::Bvh sceneBvh;
+    rg::SoftwareOcclusion occlusion;
+
+    const rg::TextureRegistry::Stats& textureStats = rg::TextureRegistry::Instance().stats();
+    std::cout << "TEXTURES:: " << textureStats.textures << " unique model textures, "
+              << textureStats.pathHits << " shared by path, " << textureStats.contentHits
+              << " shared by content" << std::endl;
+
+    if (MODEL_VERTEX_FORMAT == VertexFormat::Packed)
+    {
+        rg::PackingError packingError;
+        for (const Model* model : {&ourModel, &house, &patrick, &squid, &sponge, &krabs, &karen})
+            packingError.merge(model->PackingError());
+        std::cout << "VERTICES:: packed, max error: position " << packingError.position
+                  << ", normal " << packingError.normalDegrees << " deg, tangent "
+                  << packingError.tangentDegrees << " deg, uv " << packingError.texCoord
+                  << std::endl;
+    }
+
+    rg::GeometryPool::Stats geometryStats = Mesh::Pool(MODEL_VERTEX_FORMAT).stats();
+    std::cout << "GEOMETRY:: " << geometryStats.allocations << " meshes ("
+              << geometryStats.shortIndexAllocations << " with 16-bit indices), vertices "
+              << geometryStats.vertexBytes / 1024 << " / "
+              << geometryStats.vertexCapacityBytes / 1024 << " KB, indices "
+              << geometryStats.indexBytes / 1024 << " / "
+              << geometryStats.indexCapacityBytes / 1024 << " KB" << std::endl;
+
     PointLight& pointLight = programState->pointLight;
     pointLight.position = glm::vec3(4.0f, 4.0, 0.0);
     pointLight.ambient = glm::vec3(2.0f, 2.0f, 2.0f);
@@ -258,29 +533,28 @@ auto main() -> int
 
         0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 1.0f, -0.5f, 0.0f, 1.0f, 1.0f, 1.0f, 0.5f,  0.0f, 1.0f, 0.0f};
 
-    // transparent VAO
+    // transparent VAO, with one model matrix per kelp quad
+    rg::InstanceBuffer kelpInstances;
     unsigned int transparentVAO, transparentVBO;
     glGenVertexArrays(1, &transparentVAO);
     glGenBuffers(1, &transparentVBO);
-    glBindVertexArray(transparentVAO);
+    glState.bindVertexArray(transparentVAO);
     glBindBuffer(GL_ARRAY_BUFFER, transparentVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(transparentVertices), transparentVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)nullptr);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glBindVertexArray(0);
+    kelpInstances.setupAttributes();
+    glState.bindVertexArray(0);
 
-    unsigned int transparentTexture =
-        loadTexture(FileSystem::getPath("resources/textures/kelp.png").c_str());
+    unsigned int transparentTexture = loadTexture(
+        texturePipeline, FileSystem::getPath("resources/textures/kelp.png").c_str());
 
-    vector<glm::vec3> vegetation{
-        glm::vec3(18.0f, -12.0f, 25.0f), glm::vec3(18.1f, -12.1f, 25.1f),
-        glm::vec3(18.2f, -12.2f, 25.2f), glm::vec3(18.3f, -12.3f, 25.3f),
-        glm::vec3(18.4f, -12.4f, 25.4f)};
+    int uploadedKelpCount = -1;
+    vector<glm::mat4> crowd;
 
-    blendingShader.use();
-    blendingShader.setInt("texture1", 0);
+    const GLint kelpTextureUnit = blendingShader.samplerUnit("texture1");
 
     // skybox
     float skyboxVertices[] = {// positions
@@ -306,14 +580,12 @@ auto main() -> int
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
+    glState.bindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)nullptr);
 
-    stbi_set_flip_vertically_on_load(false);
-
     vector<std::string> faces{
         FileSystem::getPath("resources/textures/skybox/right.jpg"),
         FileSystem::getPath("resources/textures/skybox/left.jpg"),
@@ -321,62 +593,132 @@ auto main() -> int
         FileSystem::getPath("resources/textures/skybox/down.jpg"),
         FileSystem::getPath("resources/textures/skybox/front.jpg"),
         FileSystem::getPath("resources/textures/skybox/back.jpg")};
-    unsigned int cubemapTexture = loadCubemap(faces);
+    unsigned int cubemapTexture = loadCubemap(texturePipeline, faces);
 
     // skyboxShader.use();
     // skyboxShader.setInt("skybox", 0);
 
+    // the benchmark flies once around the scene: over the house, past patrick and the krusty
+    // krab, and back behind gary
+    rg::CameraPath benchPath({
+        {glm::vec3(25.0f, -16.0f, 32.0f), glm::vec3(10.0f, -18.0f, 8.0f)},
+        {glm::vec3(-12.0f, -14.0f, 24.0f), glm::vec3(1.0f, -18.0f, 6.0f)},
+        {glm::vec3(-18.0f, -12.0f, -12.0f), glm::vec3(1.0f, -18.0f, 0.0f)},
+        {glm::vec3(8.0f, -17.0f, -20.0f), glm::vec3(1.0f, -19.0f, -5.0f)},
+        {glm::vec3(38.0f, -15.0f, -2.0f), glm::vec3(25.0f, -19.0f, 15.0f)},
+        {glm::vec3(40.0f, -17.0f, 26.0f), glm::vec3(20.0f, -18.0f, 12.0f)},
+    });
+    rg::BenchReport benchReport;
+    // timed and replayed frames start with every texture resident
+    if (bench || inputPlayer.playing())
+        texturePipeline.finish();
+    if (bench)
+    {
+        glFinish();
+        benchReport.startupMs =
+            std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+        benchReport.renderer = (const char*)glGetString(GL_RENDERER);
+        benchReport.width = SCR_WIDTH;
+        benchReport.height = SCR_HEIGHT;
+        std::cout << "BENCH:: started in " << benchReport.startupMs << " ms, rendering "
+                  << (inputPlayer.playing() ? replayPath : std::to_string(benchFrames) + " frames")
+                  << std::endl;
+    }
+
     // render loop
 
-    while (!glfwWindowShouldClose(window))
+    int frame = 0;
+    while (bench ? frame < benchFrames : !glfwWindowShouldClose(window))
     {
+        rg::Profiler::Instance().endFrame();
+        RG_PROFILE_ZONE("Frame");
+        Clock::time_point frameStart = Clock::now();
+
         // per-frame time logic
 
-        float currentFrame = glfwGetTime();
+        // a replay steps through the recorded frame times, so deltaTime is the recorded one too
+        float currentFrame;
+        if (inputPlayer.playing())
+        {
+            if (!inputPlayer.nextFrame(currentFrame))
+                break;
+        }
+        else
+            currentFrame = bench ? frame * BENCH_TIMESTEP : glfwGetTime();
+        inputRecorder.beginFrame(currentFrame);
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         // input
 
-        processInput(window);
+        if (bench && !inputPlayer.playing())
+        {
+            rg::CameraPath::Key key = benchPath.sample((float)frame / (float)benchFrames);
+            AimCamera(programState->camera, key.position, key.target);
+        }
+        else
+        {
+            RG_PROFILE_ZONE("Input");
+            processInput(window);
+        }
+
+        gpuTimer.beginFrame();
+        passTimes = gpuTimer.latest();
+        passTimesDropped = gpuTimer.dropped();
+
+        // finish textures whose decode completed since the last frame
+        gpuTimer.begin("Texture uploads");
+        texturePipeline.drainUploads(TEXTURE_UPLOAD_BUDGET_MS);
 
         // render
 
+        // everything up to the first draw: uniforms, culling and submission
+        gpuTimer.begin("Setup");
         glClearColor(
             programState->clearColor.r, programState->clearColor.g, programState->clearColor.b,
             1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // don't forget to enable shader before setting uniforms
-        ourShader.use();
         pointLight.position = glm::vec3(4.0 * cos(currentFrame), 4.0f, 4.0 * sin(currentFrame));
-        ourShader.setVec3("pointLight.position", pointLight.position);
-        ourShader.setVec3("pointLight.ambient", pointLight.ambient);
-        ourShader.setVec3("pointLight.diffuse", pointLight.diffuse);
-        ourShader.setVec3("pointLight.specular", pointLight.specular);
-        ourShader.setFloat("pointLight.constant", pointLight.constant);
-        ourShader.setFloat("pointLight.linear", pointLight.linear);
-        ourShader.setFloat("pointLight.quadratic", pointLight.quadratic);
-        ourShader.setVec3("viewPosition", programState->camera.Position);
-        ourShader.setFloat("material.shininess", 32.0f);
-        ourShader.setVec3("lightPos", programState->pointLight.position);
         // view/projection transformations
         glm::mat4 projection = glm::perspective(
             glm::radians(programState->camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f,
             100.0f);
         glm::mat4 view = programState->camera.GetViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
+        rg::FrameData frameData;
+        frameData.projection = projection;
+        frameData.view = view;
+        frameData.viewPosition = programState->camera.Position;
+        frameData.time = currentFrame;
+        frameBuffer.update(frameData);
+
+        rg::LightData lightData = {};
+        lightData.pointLight.position = pointLight.position;
+        lightData.pointLight.ambient = pointLight.ambient;
+        lightData.pointLight.diffuse = pointLight.diffuse;
+        lightData.pointLight.specular = pointLight.specular;
+        lightData.pointLight.constant = pointLight.constant;
+        lightData.pointLight.linear = pointLight.linear;
+        lightData.pointLight.quadratic = pointLight.quadratic;
         // directional light
-        ourShader.setVec3("dirLight.direction", glm::vec3(0.5f, 0.7f, 0.4f));
-        ourShader.setVec3("dirLight.ambient", glm::vec3(0.3f));
-        ourShader.setVec3("dirLight.diffuse", glm::vec3(0.4f));
-        ourShader.setVec3("dirLight.specular", glm::vec3(0.2f));
-
-        ourShader.setBool("blinn", programState->blinn);
+        lightData.dirLight.direction = glm::vec3(0.5f, 0.7f, 0.4f);
+        lightData.dirLight.ambient = glm::vec3(0.3f);
+        lightData.dirLight.diffuse = glm::vec3(0.4f);
+        lightData.dirLight.specular = glm::vec3(0.2f);
+        lightData.blinn = programState->blinn;
+        lightBuffer.update(lightData);
 
-        glDisable(GL_CULL_FACE);
+        // don't forget to enable shader before setting uniforms
+        ourShader.use();
+        ourShader.set(modelShininess, 32.0f);
+        lodStats.reset();
+        rg::LodSelector lodSelector(
+            programState->camera.Position, glm::radians(programState->camera.Zoom),
+            (float)SCR_HEIGHT, programState->lodBias, &lodStats);
+        cullStats.reset();
+        rg::FrustumCuller culler(projection * view, programState->frustumCulling, &cullStats);
+
+        renderQueue.reset(100.0f);
         // render the loaded model
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(
@@ -386,8 +728,7 @@ auto main() -> int
             model,
             glm::vec3(
                 programState->garyScale)); // it's a bit too big for our scene, so scale it down
-        ourShader.setMat4("model", model);
-        ourModel.Draw(ourShader);
+        place(ourModel, model);
 
         // render the house model
         model = glm::mat4(1.0f);
@@ -404,8 +745,7 @@ auto main() -> int
             model,
             glm::vec3(
                 programState->houseScale)); // it's a bit too big for our scene, so scale it down
-        ourShader.setMat4("model", model);
-        house.Draw(ourShader);
+        place(house, model);
 
         // render the patrick model
         model = glm::mat4(1.0f);
@@ -422,8 +762,7 @@ auto main() -> int
             model,
             glm::vec3(
                 programState->patrickScale)); // it's a bit too big for our scene, so scale it down
-        ourShader.setMat4("model", model);
-        patrick.Draw(ourShader);
+        place(patrick, model);
 
         // render the squid model
         model = glm::mat4(1.0f);
@@ -440,10 +779,8 @@ auto main() -> int
             model,
             glm::vec3(
                 programState->squidScale)); // it's a bit too big for our scene, so scale it down
-        ourShader.setMat4("model", model);
-        squid.Draw(ourShader);
+        place(squid, model);
 
-        glEnable(GL_CULL_FACE);
         // render the sponge model
         model = glm::mat4(1.0f);
         model = glm::translate(
@@ -453,16 +790,14 @@ auto main() -> int
             model,
             glm::vec3(
                 programState->spongeScale)); // it's a bit too big for our scene, so scale it down
-        ourShader.setMat4("model", model);
-        sponge.Draw(ourShader);
-        glDisable(GL_CULL_FACE);
+        place(sponge, model);
 
         /*// render the krusty model
         model = glm::mat4(1.0f);
         model = glm::translate(model,programState->krustyPosition); // translate it down so it's at
         the center of the scene model = glm::scale(model, glm::vec3(programState->krustyScale)); //
         it's a bit too big for our scene, so scale it down ourShader.setMat4("model", model);
-        krusty.Draw(ourShader);
+        krusty.Draw(ourShader, model, lodSelector);
 */
         // render the krabs model
         model = glm::mat4(1.0f);
@@ -473,8 +808,7 @@ auto main() -> int
             model,
             glm::vec3(
                 programState->krabsScale)); // it's a bit too big for our scene, so scale it down
-        ourShader.setMat4("model", model);
-        krabs.Draw(ourShader);
+        place(krabs, model);
 
         // render the karen model
         model = glm::mat4(1.0f);
@@ -485,56 +819,296 @@ auto main() -> int
             model,
             glm::vec3(
                 programState->karenScale)); // it's a bit too big for our scene, so scale it down
-        ourShader.setMat4("model", model);
-        karen.Draw(ourShader);
-
-        blendingShader.use();
-        blendingShader.setMat4("projection", projection);
-        blendingShader.setMat4("view", view);
-        glBindVertexArray(transparentVAO);
-        glBindTexture(GL_TEXTURE_2D, transparentTexture);
-        for (auto & i : vegetation)
+        place(karen, model);
+
+        // the ImGui drag controls move objects every frame. Refitting keeps the tree valid; once
+        // the moves have made it much worse than a fresh build, it is rebuilt.
+        {
+            RG_PROFILE_ZONE("Scene BVH");
+            for (size_t i = 0; i < scene.size(); i++)
+                sceneBounds[i] = scene[i].model->bounds.transformed(scene[i].transform);
+            if (sceneBvh.empty())
+                sceneBvh.build(sceneBounds);
+            else
+            {
+                sceneBvh.refit(sceneBounds);
+                if (sceneBvh.cost() > 2.0f * sceneBvh.builtCost())
+                    sceneBvh.build(sceneBounds);
+            }
+
+            // whole models are culled through the tree, their meshes one by one in Submit
+            std::fill(sceneVisible.begin(), sceneVisible.end(), !programState->frustumCulling);
+            if (programState->frustumCulling)
+                sceneBvh.queryFrustum(
+                    culler.frustum, [&](unsigned int i) { sceneVisible[i] = 1; });
+        }
+
+        // objects that are big on screen become occluders, and every object left in the frustum
+        // is tested against them before it is submitted
+        if (programState->occlusionCulling)
+        {
+            RG_PROFILE_ZONE("Software occlusion");
+            occlusion.begin(projection * view);
+            for (size_t i = 0; i < scene.size(); i++)
+            {
+                float distance = glm::length(sceneBounds[i].center - programState->camera.Position);
+                if (sceneVisible[i] && sceneBounds[i].radius > OCCLUDER_MIN_SIZE * distance)
+                    occlusion.addOccluder(scene[i].occluder, scene[i].transform);
+            }
+            occlusion.rasterize(&threadPool);
+        }
+        queriedObjects.clear();
+        deferredObjects.clear();
+        if (programState->gpuOcclusion)
+            occlusionQueries.beginFrame(scene.size());
+        for (unsigned int i = 0; i < scene.size(); i++)
+        {
+            RG_PROFILE_ZONE("Submit");
+            Model& object = *scene[i].model;
+            if (!sceneVisible[i])
+            {
+                cullStats.modelsCulled++;
+                cullStats.meshesCulled += object.meshes.size();
+                continue;
+            }
+            if (programState->occlusionCulling && !occlusion.visible(sceneBounds[i]))
+                continue;
+            if (programState->gpuOcclusion)
+            {
+                queriedObjects.push_back(i);
+                // drawn after the queries, under conditional rendering
+                if (!occlusionQueries.visibleLastFrame(i))
+                {
+                    deferredObjects.push_back(i);
+                    continue;
+                }
+            }
+            object.Submit(
+                renderQueue, ourShader, scene[i].transform, lodSelector, scene[i].cullFace,
+                &culler);
+        }
+        occlusionStats = programState->occlusionCulling ? occlusion.stats() : rg::OcclusionStats();
+
+        // what the camera looks at, shown in the culling window
+        rg::Ray viewRay;
+        viewRay.origin = programState->camera.Position;
+        viewRay.direction = programState->camera.Front;
+        rg::RayHit picked = sceneBvh.raycast(viewRay);
+        lookingAt = picked.primitive == rg::Bvh::NONE ? "nothing" : scene[picked.primitive].name;
+
+        // the kelp field is one instanced draw after everything opaque; the quads are alpha
+        // tested, so they don't need sorting among themselves
+        if (programState->kelpCount != uploadedKelpCount)
         {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, i);
-            blendingShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+            vector<glm::mat4> kelp = KelpField(programState->kelpCount);
+            kelpInstances.upload(kelp.data(), kelp.size());
+            uploadedKelpCount = programState->kelpCount;
         }
+        rg::DrawPacket quads;
+        quads.program = renderQueue.addProgram(blendingShader.ID, -1);
+        quads.vao = renderQueue.addVertexArray(transparentVAO);
+        quads.material = renderQueue.addMaterial(&transparentTexture, &kelpTextureUnit, 1);
+        quads.draw = [](const void*, unsigned int count)
+        { glDrawArraysInstanced(GL_TRIANGLES, 0, 6, count); };
+        quads.argument = uploadedKelpCount;
+        renderQueue.submit(
+            quads, rg::RenderPass::Transparent,
+            glm::length(glm::vec3(18.0f, -12.0f, 25.0f) - programState->camera.Position));
+
+        // Drawn between the passes of the queue, after everything opaque and before the kelp
+        // blends over it: the GPU occlusion queries and the crowd. Boxes are tested against the
+        // depth of everything drawn so far; objects hidden last frame are left to the GPU to
+        // drop. Their meshes go through a queue of their own, one object at a time, and are not
+        // counted in the LOD or cull stats since the GPU may drop them.
+        bool opaqueFinished = false;
+        auto finishOpaque = [&]()
+        {
+            if (opaqueFinished)
+                return;
+            opaqueFinished = true;
+            if (programState->gpuOcclusion)
+            {
+                RG_PROFILE_ZONE("GPU occlusion");
+                rg::GpuTimer::Scope gpuPass(gpuTimer, "GPU occlusion");
+                occlusionQueries.queryBoxes(
+                    queriedObjects, sceneBounds, programState->camera.Position);
+                rg::LodSelector uncounted = lodSelector;
+                uncounted.stats = nullptr;
+                rg::FrustumCuller uncountedCuller = culler;
+                uncountedCuller.stats = nullptr;
+                for (unsigned int i : deferredObjects)
+                {
+                    deferredQueue.reset(100.0f);
+                    scene[i].model->Submit(
+                        deferredQueue, ourShader, scene[i].transform, uncounted, scene[i].cullFace,
+                        &uncountedCuller);
+                    occlusionQueries.beginConditional(i);
+                    deferredQueue.execute();
+                    occlusionQueries.endConditional();
+                }
+                queryStats = occlusionQueries.stats();
+            }
+            else
+                queryStats = rg::OcclusionQueries::Stats();
+
+            // copies of patrick in rows behind him, one instanced draw per mesh
+            if (programState->crowdCount > 0)
+            {
+                RG_PROFILE_ZONE("Crowd");
+                rg::GpuTimer::Scope gpuPass(gpuTimer, "Crowd");
+                crowd.resize(programState->crowdCount);
+                for (int i = 0; i < programState->crowdCount; i++)
+                {
+                    glm::vec3 offset((float)(i % 32 + 1) * 3.0f, 0.0f, -(float)(i / 32) * 3.0f);
+                    glm::mat4 copy =
+                        glm::translate(glm::mat4(1.0f), programState->patrickPosition + offset);
+                    crowd[i] = glm::scale(copy, glm::vec3(programState->patrickScale));
+                }
+                instancedShader.use();
+                instancedShader.set(crowdShininess, 32.0f);
+                // culled like patrick himself, not like whichever packet the queue ran last
+                glState.disable(GL_CULL_FACE);
+                patrick.DrawInstanced(instancedShader, crowd);
+            }
+        };
+
+        {
+            RG_PROFILE_ZONE("Render queue");
+            renderQueue.execute(
+                [&](rg::RenderPass pass)
+                {
+                    if (pass == rg::RenderPass::Transparent)
+                        finishOpaque();
+                    gpuTimer.begin(pass == rg::RenderPass::Opaque ? "Models" : "Kelp");
+                });
+            gpuTimer.end();
+        }
+        renderStats = renderQueue.stats();
+        // nothing transparent was queued
+        finishOpaque();
 
         // draw skybox
-        glDepthMask(GL_FALSE);
-        glDepthFunc(GL_LEQUAL); // change depth function so depth test passes when values are equal
-                                // to depth buffer's content
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(
-            programState->camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", glm::mat4(glm::mat3(view)));
-        skyboxShader.setMat4("projection", projection);
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthMask(GL_TRUE);
-        glDepthFunc(GL_LESS); // set depth function back to default
+        {
+            RG_PROFILE_ZONE("Skybox");
+            rg::GpuTimer::Scope gpuPass(gpuTimer, "Skybox");
+            glState.depthMask(false);
+            glState.depthFunc(GL_LEQUAL); // change depth function so depth test passes when values
+                                          // are equal to depth buffer's content
+            glState.disable(GL_CULL_FACE);
+            skyboxShader.use();
+            // skybox cube
+            glState.bindVertexArray(skyboxVAO);
+            glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glState.depthMask(true);
+            glState.depthFunc(GL_LESS); // set depth function back to default
+        }
 
+        // model meshes, the box queries, the kelp field, the crowd and the skybox; draws under
+        // conditional rendering are left out
+        frameCounts.drawCalls = queryStats.issued + 2;
+        frameCounts.triangles = 12ull * queryStats.issued + 2ull * uploadedKelpCount + 12;
+        for (unsigned int level = 0; level < rg::MAX_LODS; level++)
+        {
+            frameCounts.drawCalls += lodStats.meshes[level];
+            frameCounts.triangles += lodStats.triangles[level];
+        }
+        if (programState->crowdCount > 0)
+            for (const Mesh& mesh : patrick.meshes)
+            {
+                frameCounts.drawCalls++;
+                frameCounts.triangles +=
+                    (unsigned long long)mesh.lods[0].indexCount / 3 * programState->crowdCount;
+            }
+
+        glStateStats = glState.stats();
+        glState.resetStats();
         if (programState->ImGuiEnabled)
-            DrawImGui(programState);
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+        {
+            RG_PROFILE_ZONE("ImGui");
+            rg::GpuTimer::Scope gpuPass(gpuTimer, "ImGui");
+            // edits made through the controls go into the trace. A replay draws the controls
+            // but drops what they change for the recorded edits.
+            unsigned char before[sizeof(ProgramState)];
+            std::memcpy(before, programState, sizeof(ProgramState));
+            if (!bench)
+            {
+                DrawImGui(programState);
+                // the ImGui renderer binds its own program, textures and vertex array
+                glState.invalidate();
+            }
+            if (inputPlayer.playing())
+                std::memcpy(programState, before, sizeof(ProgramState));
+            inputRecorder.stateEdits(before, programState);
+        }
+        inputPlayer.applyStateEdits(programState);
+        gpuTimer.endFrame();
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (bench)
+        {
+            // the frame is timed until the GPU is done with it; nothing is presented
+            {
+                RG_PROFILE_ZONE("Finish");
+                glFinish();
+            }
+            double frameMs =
+                std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+            benchReport.addFrame(frameMs, frameCounts.drawCalls, frameCounts.triangles);
+        }
+        else
+        {
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+
+            {
+                RG_PROFILE_ZONE("Swap");
+                glfwSwapBuffers(window);
+            }
+            RG_PROFILE_ZONE("Poll events");
+            glfwPollEvents();
+        }
+        // the recorded events reach the callbacks at the point the window's would have
+        if (inputPlayer.playing())
+            inputPlayer.dispatch(
+                [window](int key, int scancode, int action, int mods)
+                { key_callback(window, key, scancode, action, mods); },
+                [window](double x, double y) { mouse_callback(window, x, y); },
+                [window](double x, double y) { scroll_callback(window, x, y); });
+        frame++;
     }
+    inputRecorder.close();
 
     glDeleteVertexArrays(1, &skyboxVAO);
     glDeleteVertexArrays(1, &skyboxVBO);
     glDeleteVertexArrays(1, &transparentVAO);
     glDeleteVertexArrays(1, &transparentVBO);
+    kelpInstances.destroy();
 
     glDeleteTextures(1, &cubemapTexture);
     glDeleteTextures(1, &transparentTexture);
+    // model textures are owned by the registry and geometry by the shared pools; free them while
+    // the context is still alive
+    rg::TextureRegistry::Instance().clear();
+    Mesh::DestroyPools();
+    frameBuffer.destroy();
+    lightBuffer.destroy();
+    occlusionQueries.destroy();
+    gpuTimer.destroy();
+
+    if (bench)
+    {
+        delete programState;
+        headless.destroy();
+        std::cout << "BENCH:: p50 " << benchReport.percentileMs(50.0) << " ms, p95 "
+                  << benchReport.percentileMs(95.0) << " ms, p99 "
+                  << benchReport.percentileMs(99.0) << " ms" << std::endl;
+        if (!benchReport.write(benchReportPath))
+        {
+            std::cout << "BENCH:: failed to write " << benchReportPath << std::endl;
+            return -1;
+        }
+        std::cout << "BENCH:: report written to " << benchReportPath << std::endl;
+        return 0;
+    }
 
     programState->SaveToFile("resources/program_state.txt");
     delete programState;
@@ -552,19 +1126,27 @@ auto main() -> int
 
 void processInput(GLFWwindow* window)
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (keyPressed(window, GLFW_KEY_ESCAPE) && window)
         glfwSetWindowShouldClose(window, true);
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    if (keyPressed(window, GLFW_KEY_W))
         programState->camera.ProcessKeyboard(FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    if (keyPressed(window, GLFW_KEY_S))
         programState->camera.ProcessKeyboard(BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    if (keyPressed(window, GLFW_KEY_A))
         programState->camera.ProcessKeyboard(LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    if (keyPressed(window, GLFW_KEY_D))
         programState->camera.ProcessKeyboard(RIGHT, deltaTime);
 }
 
+// whether a key is held; a replay answers from the trace instead of the window
+bool keyPressed(GLFWwindow* window, int key)
+{
+    if (inputPlayer.playing())
+        return inputPlayer.keyPressed(key);
+    return glfwGetKey(window, key) == GLFW_PRESS;
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -578,6 +1160,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 {
+    inputRecorder.cursor(xpos, ypos);
     if (firstMouse)
     {
         lastX = xpos;
@@ -599,6 +1182,7 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
+    inputRecorder.scroll(xoffset, yoffset);
     programState->camera.ProcessMouseScroll(yoffset);
 }
 
@@ -645,6 +1229,104 @@ void DrawImGui(ProgramState* programState)
         ImGui::End();
     }
 
+    {
+        ImGui::Begin("Level of detail");
+        ImGui::SliderFloat("LOD bias", &programState->lodBias, -2.0f, 4.0f);
+        for (unsigned int lod = 0; lod < rg::MAX_LODS; lod++)
+            ImGui::Text(
+                "LOD %u: %u meshes, %u triangles", lod, lodStats.meshes[lod],
+                lodStats.triangles[lod]);
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Instancing");
+        ImGui::SliderInt("Kelp quads", &programState->kelpCount, 5, 100000);
+        ImGui::SliderInt("Patrick copies", &programState->crowdCount, 0, 1000);
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Culling");
+        ImGui::Checkbox("Frustum culling", &programState->frustumCulling);
+        ImGui::Text("Meshes drawn: %u, culled: %u", cullStats.meshesDrawn, cullStats.meshesCulled);
+        ImGui::Text("Models culled: %u", cullStats.modelsCulled);
+        ImGui::Text("Looking at: %s", lookingAt);
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Occlusion");
+        ImGui::Checkbox("Software occlusion culling", &programState->occlusionCulling);
+        const rg::OcclusionStats& s = occlusionStats;
+        ImGui::Text("Occluders: %u, %u triangles", s.occluders, s.triangles);
+        ImGui::Text(
+            "Tested: %u, occluded: %u (%.0f%%)", s.tested, s.occluded,
+            s.tested ? 100.0f * s.occluded / s.tested : 0.0f);
+        ImGui::Text(
+            "Transform %.3f ms, rasterize %.3f ms, test %.3f ms", s.transformMs, s.rasterizeMs,
+            s.testMs);
+        ImGui::Separator();
+        ImGui::Checkbox("GPU occlusion queries", &programState->gpuOcclusion);
+        const rg::OcclusionQueries::Stats& q = queryStats;
+        ImGui::Text("Queries issued: %u, skipped: %u", q.issued, q.skipped);
+        ImGui::Text("Drawn conditionally: %u, hidden last frame: %u", q.conditional, q.hidden);
+        ImGui::Text("Stalls avoided: %u", q.stallsAvoided);
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Geometry pool");
+        rg::GeometryPool::Stats stats = Mesh::Pool(MODEL_VERTEX_FORMAT).stats();
+        ImGui::Text(
+            "Meshes: %u, %u with 16-bit indices", stats.allocations, stats.shortIndexAllocations);
+        ImGui::Text(
+            "Vertices: %.1f / %.1f MB, %zu free blocks, %.0f%% fragmented",
+            stats.vertexBytes / 1048576.0, stats.vertexCapacityBytes / 1048576.0,
+            stats.vertexFreeBlocks, stats.vertexFragmentation * 100.0f);
+        ImGui::Text(
+            "Indices: %.1f / %.1f MB, %zu free blocks, %.0f%% fragmented",
+            stats.indexBytes / 1048576.0, stats.indexCapacityBytes / 1048576.0,
+            stats.indexFreeBlocks, stats.indexFragmentation * 100.0f);
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Render queue");
+        ImGui::Text("Draws: %u", renderStats.packets);
+        ImGui::Text(
+            "Program binds: %u -> %u", renderStats.submitted.programs,
+            renderStats.issued.programs);
+        ImGui::Text(
+            "VAO binds: %u -> %u", renderStats.submitted.vertexArrays,
+            renderStats.issued.vertexArrays);
+        ImGui::Text(
+            "Texture binds: %u -> %u", renderStats.submitted.textures,
+            renderStats.issued.textures);
+        ImGui::Text(
+            "Cull changes: %u, transforms: %u", renderStats.cullChanges, renderStats.transforms);
+        if (renderStats.keyOverflows > 0)
+            ImGui::Text("Unsorted (index past the key): %u", renderStats.keyOverflows);
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("GL state");
+        const rg::GLState::Stats& s = glStateStats;
+        ImGui::Text("Calls issued: %u, elided: %u", s.issued(), s.elided());
+        ImGui::Text("Programs: %u / %u", s.programs.issued, s.programs.elided);
+        ImGui::Text("Vertex arrays: %u / %u", s.vertexArrays.issued, s.vertexArrays.elided);
+        ImGui::Text("Active texture: %u / %u", s.activeTextures.issued, s.activeTextures.elided);
+        ImGui::Text("Textures: %u / %u", s.textures.issued, s.textures.elided);
+        ImGui::Text("Enable/disable: %u / %u", s.capabilities.issued, s.capabilities.elided);
+        ImGui::Text("Depth mask/func: %u / %u", s.depth.issued, s.depth.elided);
+        bool verify = rg::GLState::Instance().verifying();
+        if (ImGui::Checkbox("Verify against glGet", &verify))
+            rg::GLState::Instance().setVerify(verify);
+        ImGui::Text("Mismatches: %u", s.mismatches);
+        ImGui::End();
+    }
+
     {
         ImGui::Begin("Camera info");
         const Camera& c = programState->camera;
@@ -655,108 +1337,173 @@ void DrawImGui(ProgramState* programState)
         ImGui::End();
     }
 
+    DrawPerformance();
+    DrawProfiler();
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+    inputRecorder.key(key, scancode, action, mods);
     if (key == GLFW_KEY_H && action == GLFW_PRESS)
     {
         programState->ImGuiEnabled = !programState->ImGuiEnabled;
         if (programState->ImGuiEnabled)
         {
             programState->CameraMouseMovementUpdateEnabled = false;
-            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+            if (window)
+                glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
         }
-        else
+        else if (window)
         {
             glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
         }
     }
 
-    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS and !programState->blinnKeyPressed)
+    if (keyPressed(window, GLFW_KEY_B) and !programState->blinnKeyPressed)
     {
         programState->blinn = !programState->blinn;
         programState->blinnKeyPressed = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_RELEASE)
+    if (!keyPressed(window, GLFW_KEY_B))
     {
         programState->blinnKeyPressed = false;
     }
 }
 
-auto loadCubemap(vector<std::string> faces) -> unsigned int
+auto loadCubemap(rg::TexturePipeline& textures, vector<std::string> faces) -> unsigned int
+{
+    rg::TextureOptions options;
+    options.flip = false;
+    options.mipmaps = false;
+    options.clamp = true;
+    return textures.loadCubemap(faces, options);
+}
+
+auto loadTexture(rg::TexturePipeline& textures, char const* path) -> unsigned int
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    rg::TextureOptions options;
+    options.clampAlpha = true; // for this tutorial: use GL_CLAMP_TO_EDGE to prevent
+                               // semi-transparent borders. Due to interpolation it takes texels
+                               // from next repeat
+    return textures.load2D(path, options);
+}
 
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); ++i)
+// flame graph of the last frames, one lane per thread with a row per zone depth
+void DrawProfiler()
+{
+    static int frames = 3;
+    static bool paused = false;
+    static uint64_t from = 0, to = 1;
+    static vector<rg::Profiler::ThreadEvents> threads;
+    rg::Profiler& profiler = rg::Profiler::Instance();
+
+    ImGui::Begin("Profiler");
+    bool enabled = profiler.enabled();
+    if (ImGui::Checkbox("Record", &enabled))
+        profiler.setEnabled(enabled);
+    ImGui::SameLine();
+    ImGui::Checkbox("Pause", &paused);
+    ImGui::SameLine();
+    if (ImGui::Button("Save trace"))
+        profiler.writeChromeTrace("profile.json");
+    ImGui::SliderInt("Frames", &frames, 1, 30);
+    if (!paused)
     {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(
-                GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB,
-                GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
+        profiler.frameRange(frames, from, to);
+        threads = profiler.snapshot(from, to);
+    }
+    double msPerTick = profiler.nanosecondsPerTick() / 1e6;
+    double span = (double)std::max<uint64_t>(to - from, 1);
+    ImGui::Text("%.2f ms", span * msPerTick);
+
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    float width = std::max(ImGui::GetContentRegionAvail().x, 1.0f);
+    float rowHeight = ImGui::GetTextLineHeight() + 2.0f;
+    for (const rg::Profiler::ThreadEvents& thread : threads)
+    {
+        if (thread.events.empty())
+            continue;
+        ImGui::Text("%s", thread.name);
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        unsigned int depth = 0;
+        for (const rg::ProfileEvent& event : thread.events)
         {
-            std::cerr << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
+            depth = std::max(depth, event.depth + 1);
+            double begin = (double)(std::max(event.begin, from) - from) / span;
+            double end = (double)(std::min(event.end, to) - from) / span;
+            float x0 = origin.x + (float)begin * width;
+            float x1 = std::max(origin.x + (float)end * width, x0 + 1.0f);
+            ImVec2 min(x0, origin.y + event.depth * rowHeight);
+            ImVec2 max(x1, min.y + rowHeight - 1.0f);
+            // the same zone gets the same color in every frame
+            float hue = (float)(rg::fnv1a64(event.name, std::strlen(event.name)) % 360) / 360.0f;
+            drawList->AddRectFilled(min, max, ImColor::HSV(hue, 0.5f, 0.7f));
+            if (x1 - x0 > 20.0f)
+            {
+                drawList->PushClipRect(min, max, true);
+                drawList->AddText(
+                    ImVec2(x0 + 2.0f, min.y + 1.0f), IM_COL32_WHITE, event.name);
+                drawList->PopClipRect();
+            }
+            if (ImGui::IsMouseHoveringRect(min, max))
+                ImGui::SetTooltip(
+                    "%s: %.3f ms", event.name, (double)(event.end - event.begin) * msPerTick);
         }
+        ImGui::Dummy(ImVec2(width, depth * rowHeight));
     }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+    ImGui::End();
 }
 
-auto loadTexture(char const* path) -> unsigned int
+// CPU and GPU time per section of the frame, with the frame's draws, triangles and state changes
+void DrawPerformance()
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format = GL_RGB; // izmenio
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(
-            GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
-            format == GL_RGBA
-                ? GL_CLAMP_TO_EDGE
-                : GL_REPEAT); // for this tutorial: use GL_CLAMP_TO_EDGE to prevent semi-transparent
-                              // borders. Due to interpolation it takes texels from next repeat
-        glTexParameteri(
-            GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
+    const int HISTORY = 120;
+    static float cpuMs[HISTORY], gpuMs[HISTORY], draws[HISTORY], triangles[HISTORY],
+        stateChanges[HISTORY];
+    static int offset = 0;
+    cpuMs[offset] = (float)passTimes.cpuMs;
+    gpuMs[offset] = (float)passTimes.gpuMs;
+    draws[offset] = (float)frameCounts.drawCalls;
+    triangles[offset] = (float)frameCounts.triangles;
+    stateChanges[offset] = (float)glStateStats.issued();
+    offset = (offset + 1) % HISTORY;
+
+    ImGui::Begin("Performance");
+    char overlay[64];
+    ImVec2 graphSize(0.0f, 40.0f);
+    std::snprintf(overlay, sizeof(overlay), "%.2f ms", passTimes.cpuMs);
+    ImGui::PlotLines("CPU", cpuMs, HISTORY, offset, overlay, 0.0f, FLT_MAX, graphSize);
+    std::snprintf(overlay, sizeof(overlay), "%.2f ms", passTimes.gpuMs);
+    ImGui::PlotLines("GPU", gpuMs, HISTORY, offset, overlay, 0.0f, FLT_MAX, graphSize);
+    ImGui::Text(
+        "GPU results are %u frames old, %u dropped", rg::GpuTimer::FRAMES, passTimesDropped);
+
+    // both bars of every section share one scale
+    ImGui::Separator();
+    double longest = 0.001;
+    for (unsigned int i = 0; i < passTimes.count; i++)
+        longest = std::max(
+            longest, std::max(passTimes.sections[i].cpuMs, passTimes.sections[i].gpuMs));
+    for (unsigned int i = 0; i < passTimes.count; i++)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        const rg::GpuTimer::Section& section = passTimes.sections[i];
+        ImGui::Text("%s", section.name);
+        std::snprintf(overlay, sizeof(overlay), "CPU %.3f ms", section.cpuMs);
+        ImGui::ProgressBar((float)(section.cpuMs / longest), ImVec2(-1.0f, 0.0f), overlay);
+        std::snprintf(overlay, sizeof(overlay), "GPU %.3f ms", section.gpuMs);
+        ImGui::ProgressBar((float)(section.gpuMs / longest), ImVec2(-1.0f, 0.0f), overlay);
     }
 
-    return textureID;
+    ImGui::Separator();
+    std::snprintf(overlay, sizeof(overlay), "%u", frameCounts.drawCalls);
+    ImGui::PlotLines("Draws", draws, HISTORY, offset, overlay, 0.0f, FLT_MAX, graphSize);
+    std::snprintf(overlay, sizeof(overlay), "%llu", frameCounts.triangles);
+    ImGui::PlotLines("Triangles", triangles, HISTORY, offset, overlay, 0.0f, FLT_MAX, graphSize);
+    std::snprintf(overlay, sizeof(overlay), "%u", glStateStats.issued());
+    ImGui::PlotLines(
+        "State changes", stateChanges, HISTORY, offset, overlay, 0.0f, FLT_MAX, graphSize);
+    ImGui::End();
 }